@@ -0,0 +1,100 @@
+#!/usr/bin/perl -w
+
+# Checks that the strokes the engine keeps between lookups stay in step
+# with what a client sent: lookups sent the old way, whole strokes ending
+# in a blank line, and the ADD_STROKE/UNDO_STROKE/QUERY commands, mixed,
+# must give what a fresh engine gives for the same strokes.
+#
+# Usage: checkengine.pl [ENGINE ARGS...]
+
+use IO::File;
+use IPC::Open2 qw(open2);
+
+use strict;
+
+my @engine = ("./kpengine", @ARGV);
+
+# Strokes on a 200x200 pad
+my @one = ("20 100 60 98 100 97 140 96 180 95");
+my @two = ("50 60 100 59 150 58",
+	   "20 150 80 148 140 147 180 146");
+my $down = "100 20 100 60 100 100 100 140 100 180";
+
+my $failed = 0;
+
+sub start {
+    my $in = new IO::File;
+    my $out = new IO::File;
+
+    open2($in, $out, @engine) || die "Cannot run recognition engine";
+    $out->autoflush();
+    return ($in, $out);
+}
+
+sub answer {
+    my ($in, $out, $message) = @_;
+
+    print $out $message;
+    my $line = <$in>;
+    defined $line or die "Recognition engine exited";
+    return $line;
+}
+
+sub old_lookup {
+    my ($in, $out, @strokes) = @_;
+    return answer($in, $out, join("", map { "$_\n" } @strokes) . "\n");
+}
+
+sub fresh_lookup {
+    my ($in, $out) = start();
+    my $line = old_lookup($in, $out, @_);
+    close $out;
+    close $in;
+    return $line;
+}
+
+sub check {
+    my ($name, $got, $expected) = @_;
+
+    if ($got ne $expected) {
+	print "$name: got ${got}expected $expected";
+	$failed++;
+    }
+}
+
+my ($in, $out) = start();
+
+# A lookup answered from the result cache must still replace the
+# strokes kept, so a stroke added after it goes on the right ones
+old_lookup($in, $out, @one);
+old_lookup($in, $out, @two);
+old_lookup($in, $out, @one);
+check("ADD_STROKE after cached lookup",
+      answer($in, $out, "ADD_STROKE $down\nQUERY\n"),
+      fresh_lookup(@one, $down));
+
+# Strokes past the engine's limit, and strokes without points, are
+# counted, so taking them back leaves the ones before them
+my $msg = "CLEAR\n";
+$msg .= "ADD_STROKE $_\n" for (@two);
+$msg .= "ADD_STROKE $down\n" x 40;
+$msg .= "QUERY\n";
+check("Too many strokes", answer($in, $out, $msg), "K\n");
+check("UNDO_STROKE past the limit",
+      answer($in, $out, "UNDO_STROKE\n" x 40 . "QUERY\n"),
+      fresh_lookup(@two));
+
+check("Stroke without points",
+      answer($in, $out, "ADD_STROKE\nQUERY\n"), "K\n");
+check("UNDO_STROKE of stroke without points",
+      answer($in, $out, "UNDO_STROKE\nADD_STROKE $down\nQUERY\n"),
+      fresh_lookup(@two, $down));
+
+close $out;
+close $in;
+
+if ($failed) {
+    print "$failed engine checks failed\n";
+    exit 1;
+}
+print "engine checks passed\n";
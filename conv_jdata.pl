@@ -1,4 +1,10 @@
 #!/usr/bin/perl -w
+#
+# Compile jstroke/strokedata.h into jdata.dat. The characters in
+# strokedata.h are Shift-JIS; jdata.dat carries them as UTF-8 so that
+# kpengine can report Unicode code points without converting anything.
+
+use Encode;
 
 @chars = ();
 $line = 0;
@@ -19,9 +25,13 @@ while (<>) {
 	$chars[$strokecount] = "";
     }
 
-    $chars[$strokecount] .= substr($data,1,-1);
+    $char = decode("shiftjis", substr($data,1,2), Encode::FB_CROAK | Encode::LEAVE_SRC);
+    $chars[$strokecount] .= encode("UTF-8", $char) . substr($data,3,-1);
 }
 
+# Format magic and version; version 1 files had no header and SJIS entries
+print "KPJD", pack("N",2);
+
 for (0..$#chars) {
     if (defined $chars[$_]) {
 	print pack("NN",$_,length($chars[$_])+1);
@@ -0,0 +1,325 @@
+/* KanjiPad - Japanese handwriting recognition front end
+ * Copyright (C) 1997 Owen Taylor
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "corpus.h"
+
+#define HEADER_LEN 32
+#define CHAR_ENTRY_LEN 12
+
+struct _KpCorpus {
+  GMappedFile *file;
+  const guchar *data;
+  gsize length;
+  guint n_records;
+  guint n_chars;
+  const guchar *index;
+  const guchar *chars;
+};
+
+typedef struct {
+  gunichar ch;
+  guint32 seq;
+  guint64 offset;		/* in the writer's buffer */
+  guint32 len;
+} WriterEntry;
+
+struct _KpCorpusWriter {
+  GString *records;
+  GArray *entries;		/* WriterEntry */
+};
+
+static guint32
+get_u32 (const guchar *p)
+{
+  guint32 val;
+
+  memcpy (&val, p, sizeof (val));
+  return GUINT32_FROM_LE (val);
+}
+
+static guint64
+get_u64 (const guchar *p)
+{
+  guint64 val;
+
+  memcpy (&val, p, sizeof (val));
+  return GUINT64_FROM_LE (val);
+}
+
+/* Reading */
+
+KpCorpus *
+kp_corpus_open (const gchar *filename, GError **error)
+{
+  KpCorpus *corpus;
+  GMappedFile *file;
+  const guchar *data;
+  gsize length;
+  guint64 index_offset, chars_offset;
+  guint n_records, n_chars, i;
+
+  file = g_mapped_file_new (filename, FALSE, error);
+  if (!file)
+    return NULL;
+
+  data = (const guchar *)g_mapped_file_get_contents (file);
+  length = g_mapped_file_get_length (file);
+
+  if (length < HEADER_LEN || memcmp (data, KP_CORPUS_MAGIC, KP_CORPUS_MAGIC_LEN) != 0)
+    goto corrupt;
+
+  n_records = get_u32 (data + 4);
+  n_chars = get_u32 (data + 8);
+  index_offset = get_u64 (data + 16);
+  chars_offset = get_u64 (data + 24);
+
+  if (index_offset > length || (length - index_offset) / 8 < n_records ||
+      chars_offset > length || (length - chars_offset) / CHAR_ENTRY_LEN < n_chars)
+    goto corrupt;
+
+  for (i = 0; i < n_records; i++)
+    if (get_u64 (data + index_offset + 8 * i) >= index_offset)
+      goto corrupt;
+
+  for (i = 0; i < n_chars; i++)
+    {
+      const guchar *entry = data + chars_offset + CHAR_ENTRY_LEN * i;
+
+      if (get_u32 (entry + 4) > n_records ||
+	  get_u32 (entry + 8) > n_records - get_u32 (entry + 4))
+	goto corrupt;
+    }
+
+  corpus = g_new (KpCorpus, 1);
+  corpus->file = file;
+  corpus->data = data;
+  corpus->length = length;
+  corpus->n_records = n_records;
+  corpus->n_chars = n_chars;
+  corpus->index = data + index_offset;
+  corpus->chars = data + chars_offset;
+
+  return corpus;
+
+ corrupt:
+  g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+	       "'%s' is not a valid KanjiPad corpus", filename);
+  g_mapped_file_unref (file);
+  return NULL;
+}
+
+void
+kp_corpus_close (KpCorpus *corpus)
+{
+  g_mapped_file_unref (corpus->file);
+  g_free (corpus);
+}
+
+guint
+kp_corpus_n_samples (KpCorpus *corpus)
+{
+  return corpus->n_records;
+}
+
+guint
+kp_corpus_n_chars (KpCorpus *corpus)
+{
+  return corpus->n_chars;
+}
+
+KpSample *
+kp_corpus_get (KpCorpus *corpus, guint i)
+{
+  const guchar *p;
+
+  g_return_val_if_fail (i < corpus->n_records, NULL);
+
+  p = corpus->data + get_u64 (corpus->index + 8 * i);
+
+  return kp_sample_decode (&p, corpus->index);
+}
+
+gboolean
+kp_corpus_find_char (KpCorpus *corpus, gunichar ch, guint *first, guint *count)
+{
+  guint lo = 0, hi = corpus->n_chars;
+
+  while (lo < hi)
+    {
+      guint mid = (lo + hi) / 2;
+      const guchar *entry = corpus->chars + CHAR_ENTRY_LEN * mid;
+      gunichar mid_ch = get_u32 (entry);
+
+      if (mid_ch == ch)
+	{
+	  *first = get_u32 (entry + 4);
+	  *count = get_u32 (entry + 8);
+	  return TRUE;
+	}
+      else if (mid_ch < ch)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+
+  *first = *count = 0;
+  return FALSE;
+}
+
+void
+kp_corpus_shard (KpCorpus *corpus, guint n_shards, guint shard,
+		 guint *first, guint *count)
+{
+  guint64 n = corpus->n_records;
+
+  g_return_if_fail (shard < n_shards);
+
+  *first = n * shard / n_shards;
+  *count = n * (shard + 1) / n_shards - *first;
+}
+
+/* Writing */
+
+KpCorpusWriter *
+kp_corpus_writer_new (void)
+{
+  KpCorpusWriter *writer = g_new (KpCorpusWriter, 1);
+
+  writer->records = g_string_new (NULL);
+  writer->entries = g_array_new (FALSE, FALSE, sizeof (WriterEntry));
+
+  return writer;
+}
+
+void
+kp_corpus_writer_add (KpCorpusWriter *writer, const KpSample *sample)
+{
+  WriterEntry entry;
+
+  entry.ch = sample->selected;
+  entry.seq = writer->entries->len;
+  entry.offset = writer->records->len;
+  kp_sample_encode (sample, writer->records);
+  entry.len = writer->records->len - entry.offset;
+
+  g_array_append_val (writer->entries, entry);
+}
+
+static int
+compare_entries (gconstpointer a, gconstpointer b)
+{
+  const WriterEntry *ea = a, *eb = b;
+
+  if (ea->ch != eb->ch)
+    return ea->ch < eb->ch ? -1 : 1;
+  return ea->seq < eb->seq ? -1 : ea->seq > eb->seq;
+}
+
+static void
+put_u32 (FILE *file, guint32 val)
+{
+  val = GUINT32_TO_LE (val);
+  fwrite (&val, sizeof (val), 1, file);
+}
+
+static void
+put_u64 (FILE *file, guint64 val)
+{
+  val = GUINT64_TO_LE (val);
+  fwrite (&val, sizeof (val), 1, file);
+}
+
+gboolean
+kp_corpus_writer_save (KpCorpusWriter *writer, const gchar *filename,
+		       GError **error)
+{
+  GArray *entries = writer->entries;
+  gchar *tmpname = g_strconcat (filename, ".tmp", NULL);
+  guint64 offset, index_offset, chars_offset;
+  guint n_chars, i, first;
+  FILE *file;
+
+  g_array_sort (entries, compare_entries);
+
+  n_chars = 0;
+  for (i = 0; i < entries->len; i++)
+    if (i == 0 || g_array_index (entries, WriterEntry, i).ch !=
+	g_array_index (entries, WriterEntry, i - 1).ch)
+      n_chars++;
+
+  index_offset = HEADER_LEN + writer->records->len;
+  chars_offset = index_offset + 8 * (guint64)entries->len;
+
+  if (!(file = fopen (tmpname, "wb")))
+    goto error;
+
+  fwrite (KP_CORPUS_MAGIC, 1, KP_CORPUS_MAGIC_LEN, file);
+  put_u32 (file, entries->len);
+  put_u32 (file, n_chars);
+  put_u32 (file, 0);
+  put_u64 (file, index_offset);
+  put_u64 (file, chars_offset);
+
+  for (i = 0; i < entries->len; i++)
+    {
+      WriterEntry *entry = &g_array_index (entries, WriterEntry, i);
+      fwrite (writer->records->str + entry->offset, 1, entry->len, file);
+    }
+
+  offset = HEADER_LEN;
+  for (i = 0; i < entries->len; i++)
+    {
+      put_u64 (file, offset);
+      offset += g_array_index (entries, WriterEntry, i).len;
+    }
+
+  for (first = 0, i = 1; i <= entries->len; i++)
+    if (i == entries->len || g_array_index (entries, WriterEntry, i).ch !=
+	g_array_index (entries, WriterEntry, first).ch)
+      {
+	put_u32 (file, g_array_index (entries, WriterEntry, first).ch);
+	put_u32 (file, first);
+	put_u32 (file, i - first);
+	first = i;
+      }
+
+  if (ferror (file) | fclose (file) || rename (tmpname, filename) < 0)
+    goto error;
+
+  g_free (tmpname);
+  return TRUE;
+
+ error:
+  g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+	       "Can't write '%s': %s", filename, g_strerror (errno));
+  remove (tmpname);
+  g_free (tmpname);
+  return FALSE;
+}
+
+void
+kp_corpus_writer_free (KpCorpusWriter *writer)
+{
+  g_string_free (writer->records, TRUE);
+  g_array_free (writer->entries, TRUE);
+  g_free (writer);
+}
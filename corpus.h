@@ -0,0 +1,65 @@
+/* KanjiPad - Japanese handwriting recognition front end
+ * Copyright (C) 1997 Owen Taylor
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef __CORPUS_H__
+#define __CORPUS_H__
+
+#include "samples.h"
+
+/* A corpus file is a read-only, indexed collection of samples meant
+ * to be mapped into memory. All integers are little-endian.
+ *
+ *   header     "KPC1", guint32 record count, guint32 character count,
+ *              guint32 reserved, guint64 index offset, guint64 character
+ *              table offset
+ *   records    sample records as in samples.h, grouped by selected
+ *              character in code point order; within a character, in
+ *              the order they were added
+ *   index      guint64 file offset of each record
+ *   characters guint32 code point, first record, record count for each
+ *              character, sorted by code point
+ */
+
+#define KP_CORPUS_MAGIC "KPC1"
+#define KP_CORPUS_MAGIC_LEN 4
+
+typedef struct _KpCorpus KpCorpus;
+typedef struct _KpCorpusWriter KpCorpusWriter;
+
+KpCorpus *kp_corpus_open (const gchar *filename, GError **error);
+void kp_corpus_close (KpCorpus *corpus);
+
+guint kp_corpus_n_samples (KpCorpus *corpus);
+guint kp_corpus_n_chars (KpCorpus *corpus);
+/* Decode sample i; NULL if the record is corrupt */
+KpSample *kp_corpus_get (KpCorpus *corpus, guint i);
+
+/* The samples of ch are first .. first + count - 1 */
+gboolean kp_corpus_find_char (KpCorpus *corpus, gunichar ch,
+			      guint *first, guint *count);
+/* Split the samples into n_shards runs whose sizes differ by at most one */
+void kp_corpus_shard (KpCorpus *corpus, guint n_shards, guint shard,
+		      guint *first, guint *count);
+
+KpCorpusWriter *kp_corpus_writer_new (void);
+void kp_corpus_writer_add (KpCorpusWriter *writer, const KpSample *sample);
+gboolean kp_corpus_writer_save (KpCorpusWriter *writer, const gchar *filename,
+				GError **error);
+void kp_corpus_writer_free (KpCorpusWriter *writer);
+
+#endif /* __CORPUS_H__ */
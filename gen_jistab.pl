@@ -0,0 +1,47 @@
+#!/usr/bin/perl -w
+#
+# Generate jistab.c, the JIS X 0208 -> Unicode table samples.c uses
+# to read samples saved in the old, JIS-coded format. Run at build time:
+#
+#   perl gen_jistab.pl > jistab.c
+#
+# Unassigned cells get code point 0 and an empty UTF-8 string.
+
+use Encode;
+
+binmode STDOUT;
+
+print "/* Generated by gen_jistab.pl - do not edit */\n\n";
+print "#include \"jistab.h\"\n\n";
+
+my (@ucs, @utf8);
+
+for my $hi (0x21..0x7e) {
+    for my $lo (0x21..0x7e) {
+	my $jis = chr($hi) . chr($lo);
+	my $u = decode("jis0208-raw", $jis, Encode::FB_QUIET);
+
+	if (length($u) == 1) {
+	    push @ucs, ord($u);
+	    push @utf8, join("", map { sprintf("\\x%02x", $_) }
+			     unpack("C*", encode("UTF-8", $u)));
+	} else {
+	    push @ucs, 0;
+	    push @utf8, "";
+	}
+    }
+}
+
+print "const unsigned short kp_jis_ucs[KP_JIS_CELLS] = {\n";
+for (my $i = 0; $i < @ucs; $i += 8) {
+    my $last = $i + 7 < $#ucs ? $i + 7 : $#ucs;
+    print "  ", join(", ", map { sprintf("0x%04x", $_) } @ucs[$i..$last]), ",\n";
+}
+print "};\n\n";
+
+print "const char kp_jis_utf8[KP_JIS_CELLS][4] = {\n";
+for (my $i = 0; $i < @utf8; $i += 6) {
+    my $last = $i + 5 < $#utf8 ? $i + 5 : $#utf8;
+    print "  ", join(", ", map { "\"$_\"" } @utf8[$i..$last]), ",\n";
+}
+print "};\n";
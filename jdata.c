@@ -0,0 +1,148 @@
+/* KanjiPad - Japanese handwriting recognition front end
+ * Copyright (C) 1997 Owen Taylor
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "jdata.h"
+
+static void
+set_error (GError **error, const char *filename, const char *message)
+{
+  g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "%s: %s",
+	       filename, message);
+}
+
+KpJData *
+kp_jdata_load (const char *filename, GError **error)
+{
+  KpJData *jdata;
+  FILE *file;
+  char magic[4];
+  guint32 version;
+
+  if (filename)
+    {
+      file = fopen (filename, "rb");
+    }
+  else
+    {
+#ifdef G_OS_WIN32
+      char *dir = g_win32_get_package_installation_directory (NULL, NULL);
+#else
+      char *dir = g_strdup (KP_LIBDIR);
+#endif      
+      char *fname = g_build_filename (dir, "jdata.dat", NULL);
+      file = fopen (fname, "rb");
+      
+      if (!file)
+	file = fopen ("jdata.dat", "rb");
+
+      g_free (fname);
+      g_free (dir);
+      filename = "jdata.dat";
+    }
+
+  if (!file)
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_NOENT,
+		   "Can't open %s", filename);
+      return NULL;
+    }
+
+  if (fread (magic, 1, 4, file) != 4 || memcmp (magic, "KPJD", 4) != 0 ||
+      fread (&version, sizeof(version), 1, file) != 1 ||
+      GUINT32_FROM_BE(version) != KP_JDATA_VERSION)
+    {
+      set_error (error, filename,
+		 "Stroke database is in an old format; rebuild it with conv_jdata.pl");
+      fclose (file);
+      return NULL;
+    }
+
+  jdata = g_new0 (KpJData, 1);
+  jdata->paths = StrokePathsCreate ();
+  if (!jdata->paths)
+    goto nomem;
+
+  while (1)
+    {
+      int n_read;
+      unsigned int nstrokes;
+      unsigned int len;
+      guint32 buf[2];
+      char *buffer;
+
+      n_read = fread (buf, sizeof(guint32), 2, file);
+      
+      nstrokes = GUINT32_FROM_BE(buf[0]);
+      len = GUINT32_FROM_BE(buf[1]);
+
+      if ((n_read != 2) || (nstrokes >= diMaxStrokes) ||
+	  (nstrokes && jdata->dicts[nstrokes]))
+	goto corrupt;
+
+      if (nstrokes == 0)
+	break;
+
+      buffer = malloc(len);
+      if (!buffer)
+	goto nomem;
+      jdata->buffers[nstrokes] = buffer;
+
+      n_read = fread(buffer, 1, len, file);
+      if (n_read != len)
+	goto corrupt;
+
+      jdata->dicts[nstrokes] = StrokeDicCreate (buffer, nstrokes,
+						jdata->paths);
+      if (!jdata->dicts[nstrokes])
+	goto corrupt;
+    }
+  
+  fclose (file);
+  return jdata;
+
+ corrupt:
+  set_error (error, filename, "Corrupt stroke database");
+  fclose (file);
+  kp_jdata_free (jdata);
+  return NULL;
+
+ nomem:
+  set_error (error, filename, "Not enough memory for the stroke database");
+  fclose (file);
+  kp_jdata_free (jdata);
+  return NULL;
+}
+
+void
+kp_jdata_free (KpJData *jdata)
+{
+  int i;
+
+  for (i = 0; i < diMaxStrokes; i++)
+    {
+      if (jdata->dicts[i])
+	StrokeDicDestroy (jdata->dicts[i]);
+      free (jdata->buffers[i]);
+    }
+  if (jdata->paths)
+    StrokePathsDestroy (jdata->paths);
+  g_free (jdata);
+}
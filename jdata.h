@@ -0,0 +1,40 @@
+/* KanjiPad - Japanese handwriting recognition front end
+ * Copyright (C) 1997 Owen Taylor
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef __JDATA_H__
+#define __JDATA_H__
+
+#include <glib.h>
+#include "jstroke/jstroke.h"
+
+/* jdata.dat format written by conv_jdata.pl (UTF-8 entries) */
+#define KP_JDATA_VERSION 2
+
+typedef struct {
+  StrokePaths *paths;
+  StrokeDic *dicts[diMaxStrokes];	/* indexed by stroke count */
+  char *buffers[diMaxStrokes];
+} KpJData;
+
+/* Load the stroke database from filename, or if that is NULL, from
+ * jdata.dat in the install directory or the current directory.
+ */
+KpJData *kp_jdata_load (const char *filename, GError **error);
+void kp_jdata_free (KpJData *jdata);
+
+#endif /* __JDATA_H__ */
@@ -0,0 +1,38 @@
+/* KanjiPad - Japanese handwriting recognition front end
+ * Copyright (C) 1997 Owen Taylor
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef __JISTAB_H__
+#define __JISTAB_H__
+
+/* JIS X 0208 to Unicode, indexed by row and cell (0x21..0x7e each).
+ * The tables themselves are generated into jistab.c by gen_jistab.pl.
+ */
+
+#define KP_JIS_ROWS 94
+#define KP_JIS_CELLS (KP_JIS_ROWS * KP_JIS_ROWS)
+
+#define KP_JIS_VALID(hi,lo) ((hi) >= 0x21 && (hi) <= 0x7e && \
+			     (lo) >= 0x21 && (lo) <= 0x7e)
+#define KP_JIS_INDEX(hi,lo) (((hi) - 0x21) * KP_JIS_ROWS + ((lo) - 0x21))
+
+/* Code point, 0 if unmapped */
+extern const unsigned short kp_jis_ucs[KP_JIS_CELLS];
+/* NUL terminated UTF-8, "" if unmapped */
+extern const char kp_jis_utf8[KP_JIS_CELLS][4];
+
+#endif /* __JISTAB_H__ */
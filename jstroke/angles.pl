@@ -38,6 +38,13 @@
 ## It generates a lot of printout in angles.txt, testing the table driven
 ## angle32 code against the PERL5 floating point trig library functions.
 ##
+## Or, with a command line like this:
+##
+##    perl angles.pl profile >angles.profile
+##
+## it writes a kanjipad profile whose angle cost table is derived the same
+## way as the constants, for kpengine --profile.
+##
 ## This code was used to generate various "magic" angle and score values
 ## for use in JStroke 1.x.
 ##
@@ -113,6 +120,29 @@ sub ang32 {
     return $i32th % 32;
 }
 
+# ----- print_profile ---------------------------------------------------------
+# Print a profile charging each Angle32 segment direction against each
+# path direction $sCost plus $dRadConv radians, in thousandths, per step
+# apart the short way round, as the constants do; unlike ang_cost_scale,
+# the step isn't rounded first.
+
+sub print_profile {
+    my ($sCost, $dRadConv, $angScale) = @_;
+    my ($iAng, $iPath, $iDif, @costs);
+
+    for ($iAng = 0; $iAng < 32; $iAng++) {
+	for ($iPath = 0; $iPath < 32; $iPath++) {
+	    $iDif = abs($iAng - $iPath);
+	    $iDif = 32 - $iDif if ($iDif > 16);
+	    push(@costs, int(($iDif * $dRadConv * $angScale) + 0.5) + $sCost);
+	}
+    }
+
+    print "[scorer]\n";
+    print "ang_cost_model=2\n";
+    print "ang_cost=", join(';', @costs), "\n";
+}
+
 # ----- main ----------------------------------------------------------------
 
 my $weight = 100;		# To preserve precision in slope.
@@ -128,6 +158,11 @@ my $dRadConv = $dRadMax/(32/4);
 
 my $sCostConv = int(($dRadConv * $angScale) + 0.5);
 
+if (@ARGV && $ARGV[0] eq 'profile') {
+    print_profile($sCost, $dRadConv, $angScale);
+    exit 0;
+}
+
 print "dRadMax=$dRadMax dRadConv=$dRadConv sCost=$sCost sCostConv=$sCostConv\n";
 
 my ($i64th, $dRad, $dCos, $dSin, $dTan, $iCentered, $retcost);
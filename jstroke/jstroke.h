@@ -55,6 +55,14 @@
  */
 #define diMaxListCount       5
 #define diMaxXyPairs       256	/* Max pairs in stroke... */
+#define diMaxStrokes        32	/* Max strokes in a character... */
+#define diPathBufLen        16	/* Max direction codes in a stroke path */
+#define diMaxPaths      0xfffe	/* Max distinct paths, must fit a Word */
+#define diNoPath        ((UInt) 0xffffffff)
+#define diUnscored      ((ULong) -1)
+#define diAngCodes          32	/* Angle32 directions, 0 to 31 */
+#define diMaxRotate          4	/* Most 32nds user strokes are turned each way */
+#define diMaxStrokeEdits     3	/* Most strokes joined or broken in a lookup */
 
 /* ----- List Memory ---------------------------------------------------------
  * The idea here is to have a single nonmovable chunk of memory which contains
@@ -85,17 +93,140 @@ typedef struct ScoreItemStruct {
     CharPtr      m_cp;
 } ScoreItem;
 
+/* ----- StrokePaths -------------------------------------------------------
+ * Table of the distinct stroke paths (sequences of Angle32 direction
+ * codes) used anywhere in the dictionary, so per-path work can be shared.
+ */
+
+typedef struct StrokePathsStruct {
+	UInt        m_iCount;
+	UInt        m_iAlloc;
+	Byte*       m_bpCodes;		/* diPathBufLen codes per path */
+	Byte*       m_bpLen;		/* Codes used in each path */
+	Byte*       m_bpNetAng;		/* Overall Angle32 of each path */
+	UInt*       m_piHash;		/* Open addressed, path ids */
+	UInt        m_iHashSize;
+} StrokePaths;
+
+/* ----- StrokeFilter ------------------------------------------------------
+ * One of the extra filters written after '|' in an entry, such as "x1-x2!",
+ * compiled when the dictionary is loaded.  The score moves by the
+ * difference between two features of the user's strokes, each an index
+ * into the table StrokeScorerCreate fills in for the query.
+ */
+
+#define diFeatX          0		/* Start point */
+#define diFeatY          1
+#define diFeatI          2		/* End point */
+#define diFeatJ          3
+#define diFeatA          4		/* Midway between the two */
+#define diFeatB          5
+#define diFeatL          6		/* Distance between the two */
+#define diFeatCnt        7		/* Features per stroke */
+#define diFeatNone       0		/* Index of a feature that is always 0 */
+#define diFeatIndex(iStroke, iFeat) (1 + (iStroke)*diFeatCnt + (iFeat))
+#define diFeatTableLen   diFeatIndex(diMaxStrokes, 0)
+
+typedef struct StrokeFilterStruct {
+	Byte        m_iFeat[2];		/* Score moves by m_iFeat[0] - m_iFeat[1] */
+	Boolean     m_bMust;		/* A negative difference rules the entry out */
+} StrokeFilter;
+
+/* ----- StrokeDic ---------------------------------------------------------
+ * Index over one stroke count's worth of dictionary entries, built once
+ * when the database is loaded so that a scorer can visit the entries in
+ * any order rather than only by walking the packed string.  The path ids
+ * are also kept stroke by stroke, so that a block of entries can be
+ * scored a stroke at a time from contiguous memory, and the entries are
+ * listed sorted by them, so that those starting with the same strokes
+ * are together.
+ */
+
+typedef struct StrokeDicStruct {
+	CharPtr     m_cpStrokeDic;
+	UInt        m_iStrokeCnt;
+	UInt        m_iEntryCnt;
+	StrokePaths* m_pPaths;
+	CharPtr*    m_cppEntries;	/* Start of each entry (its UTF-8 char). */
+	StrokeFilter* m_pFilters;	/* Every entry's filters, in entry order */
+	UInt*       m_piFilters;	/* Entry's first filter, and one past the last */
+	Word*       m_pPathIds;		/* m_iStrokeCnt path ids per entry */
+	Word*       m_pColPathIds;	/* The same by stroke: m_iEntryCnt per stroke */
+	UInt*       m_piPrefixOrder;	/* Entries sorted by path ids, first stroke first */
+	Byte*       m_bpPrefixSame;	/* Strokes each there shares with the one before */
+} StrokeDic;
+
+/* ----- StrokeCostCache ---------------------------------------------------
+ * One user stroke's StrokeDicScoreStroke result for each path id, or
+ * diUnscored.  Valid for as long as the user stroke is unchanged.
+ */
+
+typedef struct StrokeCostCacheStruct {
+	UInt        m_iCount;
+	ULong*      m_piCost;
+} StrokeCostCache;
+
+/* ----- StrokeScorerParams -----------------------------------------------
+ * The constants StrokeDicScoreStroke works with.  The split thresholds
+ * trade recursion for accuracy, so they may be tuned against a corpus
+ * rather than left at the values the scorer was first written with.
+ * A segment's cost against a path direction comes from m_aiAngCost,
+ * which StrokeScorerAngCosts makes by m_iAngCostModel:
+ */
+
+#define diAngCostCircular    0	/* Base, plus scale per 32nd the short way round */
+#define diAngCostLinear      1	/* Base, plus scale per code apart, as JStroke had */
+#define diAngCostTable       2	/* As given, say loaded from a profile */
+
+typedef struct StrokeScorerParamsStruct {
+	ULong       m_iAngCostBase;		/* Cost of any matched segment */
+	ULong       m_iAngCostScale;	/* Added per Angle32 step off course */
+	ULong       m_iSplitDist;		/* Halve segments spanning more than this */
+	ULong       m_iSplitLen;		/*   and having more points than this, */
+	ULong       m_iSplitDepth;		/*   above this recursion depth */
+	ULong       m_iStepLen;			/* Try every split point below this length */
+	ULong       m_iStepDiv;			/*   and about this many above it */
+	ULong       m_iCornerSpan;		/* Or only this near corners, 0 for all */
+	ULong       m_iCornerTurn;		/* Least turn, in 32nds, at a corner */
+	ULong       m_iPyramidKeep;		/* Percent kept per coarse level, 0 for all */
+	ULong       m_iRotate;			/* Also try strokes turned this many 32nds */
+	ULong       m_iOrderFree;		/* Pair strokes up best, not in drawn order */
+	ULong       m_iStrokeEdits;		/* Most strokes joined or broken in two */
+	ULong       m_iEditCost;		/*   and the stroke score each one costs */
+	ULong       m_iAngCostModel;	/* diAngCostCircular etc. */
+	ULong       m_aiAngCost[diAngCodes][diAngCodes];	/* By segment, path code */
+} StrokeScorerParams;
+
 /* ----- StrokeScorer------------------------------------------------------ */
 
 typedef struct StrokeScorer *StrokeScorerPtr;
 
 typedef struct StrokeScorerStruct {
+	StrokeDic*  m_pDic;
 	CharPtr     m_cpStrokeDic;
 	RawStroke*  m_pRawStrokes;
 	UInt        m_iStrokeCnt;
 	ScoreItem*  m_pScores;
 	UInt        m_iScoreLen;
-	CharPtr     m_cpPath;
+	UInt*       m_piOrder;		/* Visiting order, NULL for dictionary order */
+	UInt        m_iVisitCnt;	/* Entries to evaluate, all but pruned ones */
+	UInt        m_iNext;		/* Next position to evaluate */
+	Boolean     m_bStarted;		/* StrokeScorerProcess has been called */
+	StrokeCostCache* m_apCache[diMaxStrokes];
+	ULong       m_iOwnCaches;	/* Bit set for each cache we must free */
+	const StrokeScorerParams* m_pParams;
+	Long        m_aiFeatures[diFeatTableLen];	/* For the extra filters */
+	Long        m_aiFeatMax[diFeatCnt];	/* Each feature's range over the */
+	Long        m_aiFeatMin[diFeatCnt];	/*   strokes, for m_iOrderFree */
+	ULong       m_iCornersDone;	/* Bit set for each stroke in m_abCorners */
+	Byte        m_abCorners[diMaxStrokes][diMaxXyPairs];	/* Split points */
+	ULong*      m_piSquared;	/* Squared cost by stroke and path id, or NULL */
+	ULong*      m_piRotSquared;	/* The same for each turn when m_iRotate is set */
+	ULong*      m_piEditCache;	/* Joined and broken stroke costs, or NULL */
+	Boolean     m_bSeeded;		/* List started by StrokeScorerSeed */
+	Boolean     m_bPrefix;		/* Entries scored on m_iStrokeCnt strokes */
+	UInt        m_iPrefixValid;	/*   and how many of those in m_aiPrefixSum */
+	ULong       m_aiPrefixSum[diMaxStrokes+1];	/*   hold for the last entry */
 } StrokeScorer;
 
 ListMem*  AppEmptyList();
@@ -103,19 +234,119 @@ Long      Angle32(Long xdif, Long ydif);
 void      ErrBox(CharPtr msg);
 void      ErrBox2(CharPtr msg1, CharPtr msg2);
 
-/* Create a StrokeScorer object. (Returns NULL if can't get memory) */
-StrokeScorer *StrokeScorerCreate  (CharPtr cpStrokeDic, RawStroke *rsp,
+/* Skip the UTF-8 character at the start of a dictionary entry */
+CharPtr       StrokeDicSkipChar   (CharPtr cp);
+
+/* Decode the stroke description at cp into Angle32 codes at cpPath.
+ * Returns the position after it, or NULL if cp isn't a stroke.
+ */
+CharPtr       StrokeDicParsePath  (CharPtr cp, CharPtr cpPath,
+								   UInt* ipPathLen /*OUT*/);
+
+/* Create an empty path table. (Returns NULL if can't get memory) */
+StrokePaths  *StrokePathsCreate   (void);
+
+/* Destroy a path table */
+void          StrokePathsDestroy  (StrokePaths *pPaths);
+
+/* Return the id of a path, adding it if new (diNoPath on failure) */
+UInt          StrokePathsAdd      (StrokePaths *pPaths, CharPtr cpPath,
+								   UInt iLen);
+
+/* Index a packed dictionary string for iStrokeCnt strokes, adding its
+ * paths to pPaths. (Returns NULL if can't get memory or malformed)
+ */
+StrokeDic    *StrokeDicCreate     (CharPtr cpStrokeDic, UInt iStrokeCnt,
+								   StrokePaths *pPaths);
+
+/* Destroy a StrokeDic object (the packed string is not freed) */
+void          StrokeDicDestroy    (StrokeDic *pDic);
+
+/* Create an empty per-stroke score cache sized for pPaths, which must
+ * not grow afterwards. (Returns NULL if can't get memory)
+ */
+StrokeCostCache *StrokeCostCacheCreate (StrokePaths *pPaths);
+
+/* Forget all cached scores */
+void          StrokeCostCacheReset   (StrokeCostCache *pCache);
+
+/* Destroy a per-stroke score cache */
+void          StrokeCostCacheDestroy (StrokeCostCache *pCache);
+
+/* Fill in the built-in scoring constants */
+void          StrokeScorerParamsInit (StrokeScorerParams *pParams);
+
+/* Remake pParams->m_aiAngCost after a change to the angle cost base,
+ * scale or model.  A diAngCostTable table is left as it is.
+ */
+void          StrokeScorerAngCosts   (StrokeScorerParams *pParams);
+
+/* Create a StrokeScorer object. (Returns NULL if can't get memory)
+ * iStrokeCnt may differ from pDic's stroke count by up to m_iStrokeEdits,
+ * for a user who joined strokes or broke them in two; each entry is then
+ * scored on its best alignment with the user's strokes, without its
+ * extra filters, and m_iRotate and m_iOrderFree are ignored.
+ */
+StrokeScorer *StrokeScorerCreate  (StrokeDic *pDic, RawStroke *rsp,
 			 					   UInt iStrokeCnt);
 
 /* Destroy a StrokeScorer object */
 void          StrokeScorerDestroy  (StrokeScorer *pScorer);
 
+/* Score user stroke iStroke through pCache, which the caller owns and
+ * may keep for the next lookup as long as that stroke is unchanged.
+ * Strokes without one get a private cache.
+ */
+void          StrokeScorerSetCache (StrokeScorer *pScorer, UInt iStroke,
+									StrokeCostCache *pCache);
+
+/* Score with pParams, which must outlive the scorer, instead of the
+ * built-in constants (NULL restores those).  Call before the first
+ * StrokeScorerProcess; caches shared with other scorers must have been
+ * filled under the same parameters.
+ */
+void          StrokeScorerSetParams (StrokeScorer *pScorer,
+									 const StrokeScorerParams *pParams);
+
+/* Rank the entries on coarse versions of the user's strokes, keeping
+ * only the best of them for full scoring, in that order.  Done by the
+ * first StrokeScorerProcess when m_iPyramidKeep is set and m_iRotate
+ * and m_iOrderFree aren't; false if can't get memory, in which case
+ * every entry is kept.
+ */
+Boolean       StrokeScorerPyramid  (StrokeScorer *pScorer);
+
+/* Rank the entries on their first m_iStrokeCnt strokes only, as ways the
+ * user's strokes so far might go on.  Entries that start the same way
+ * are scored together, without their extra filters, stroke for stroke
+ * in the order drawn: m_iRotate, m_iOrderFree and m_iPyramidKeep are
+ * ignored.  Call before the first StrokeScorerProcess, instead of
+ * StrokeScorerOrder; false if pDic has fewer strokes than the user drew.
+ */
+Boolean       StrokeScorerPrefix   (StrokeScorer *pScorer);
+
+/* Visit the entries likeliest to match first, so that a caller which
+ * stops processing early still has a useful list.  Call before the
+ * first StrokeScorerProcess.  Returns false if can't get memory, in
+ * which case dictionary order is kept.
+ */
+Boolean       StrokeScorerOrder    (StrokeScorer *pScorer);
+
 /* Process some database entries (maximum iMaxCnt, -1 for all).
- * Returns 0 when none remaining (should eventually return count remaining
- * to facilitate a progressbar.
+ * Successive calls carry on where the last one stopped.
+ * Returns the count of entries remaining, 0 when done.
  */
 Long          StrokeScorerProcess  (StrokeScorer *pScorer, Long iMaxCnt);
 
+/* Start pScorer's list with pFrom's, before the first StrokeScorerProcess,
+ * so that entries from several dictionaries compete for one list and
+ * each dictionary only has to beat the best of those before it.  An
+ * entry whose character is already listed replaces it if it scores
+ * better.
+ */
+void          StrokeScorerSeed     (StrokeScorer *pScorer,
+									StrokeScorer *pFrom);
+
 /* Return best diMaxListCount candidates processed so far */
 ListMem*      StrokeScorerTopPicks (StrokeScorer *pScorer);
 
@@ -40,6 +40,7 @@ typedef unsigned char Byte;
 typedef long Long;
 typedef unsigned long ULong;
 typedef unsigned int UInt;
+typedef unsigned short Word;
 typedef void * VoidPtr;
 typedef char * CharPtr;
 
@@ -28,82 +28,254 @@
 #include "jstroke.h"
 #include "memowrite.h"
 
+/* Block sums have SSE2 and AVX2 versions where a ULong is 64 bits wide,
+ * picked at run time; define FOR_NO_SIMD to use only the plain C one.
+ */
+#if defined(__GNUC__) && defined(__x86_64__) && __SIZEOF_LONG__ == 8 \
+	&& !defined(FOR_NO_SIMD)
+#define SIMD_BLOCK_SUMS
+#include <immintrin.h>
+#endif
+
 #define diAngCostBase       52	// See angles.pl for derivation.
 #define diAngCostScale      98	// See angles.pl for derivation.
-#define diHugeCost          (((((ULong)24)*diAngCostScale)+diAngCostBase)*100)
+#define diHugeCost(pP)      (((((ULong)24)*(pP)->m_iAngCostScale)+(pP)->m_iAngCostBase)*100)
 
 #define diMaxScoreToSquare ((ULong) 0xffff)
 #define diMaxScoreSquared  (diMaxScoreToSquare*diMaxScoreToSquare)
 
-/* 2 for Kanji SJIS pair, 2+2 for spaces, 
- * 9 for SJIS:967B,
+/* Up to 4 for the UTF-8 Kanji, 2 for spaces,
  * 1 for number sign, and 10 for numeric score, a billion served?
  */
-#define diScoreTextLen (2 + 2+2 + 9 + 1 + 10)
+#define diScoreTextLen (4 + 2 + 1 + 10)
+
+/* Entries summed together when scoring in dictionary order */
+#define diBlockLen 16
+
+Boolean   StrokeScorerEvalItem(StrokeScorer *pScorer, UInt iEntry,
+							   ULong iWorst, ULong* ipScore /*OUT*/);
+
+Boolean   StrokeScorerEvalItemRot(StrokeScorer *pScorer, UInt iEntry,
+								  ULong iWorst, ULong* ipScore /*OUT*/);
+
+Boolean   StrokeScorerEvalItemFree(StrokeScorer *pScorer, UInt iEntry,
+								   ULong iWorst, ULong* ipScore /*OUT*/);
+
+static ULong StrokeAssign(ULong* piCost, UInt iCnt, Byte* bpUser /*OUT*/);
+
+Boolean   StrokeScorerEvalItemAlign(StrokeScorer *pScorer, UInt iEntry,
+									ULong iWorst, ULong* ipScore /*OUT*/);
+
+ULong     StrokeScorerEditCost(StrokeScorer *pScorer, UInt iStroke,
+							   UInt iPathId, UInt iNextPathId);
+
+ULong*    StrokeScorerRotSquared(StrokeScorer *pScorer, UInt iStroke,
+								 UInt iPathId);
+
+static void StrokeDicScoreStrokeRot(const StrokeScorerParams* pParams,
+									Byte* bpX, Byte* bpY, Byte* bpCorner,
+									UInt iLen, CharPtr cpPath, UInt iPathLen,
+									UInt iDepth, UInt iRotate,
+									ULong* piScore /*OUT*/);
+
+ULong     StrokeScorerStrokeCost(StrokeScorer *pScorer, UInt iStroke,
+								 UInt iPathId);
+
+ULong     StrokeScorerRejectSum(StrokeScorer *pScorer, UInt iEntry,
+								ULong iWorst);
+
+ULong     StrokeScorerRejectSumFree(StrokeScorer *pScorer, UInt iEntry,
+									ULong iWorst);
+
+ULong     StrokeScorerFinish(StrokeScorer *pScorer, UInt iEntry, ULong iSum,
+							 Byte* bpUser);
+
+Long      StrokeScorerProcessPrefix(StrokeScorer *pScorer, Long iMaxCnt);
 
-#define diPathBufLen        16
+void      StrokeScorerInsert(StrokeScorer *pScorer, UInt iEntry, ULong iScore);
 
-CharPtr   StrokeScorerEvalItem(StrokeScorer *pScorer, CharPtr cpEntry,
-							   ULong* ipScore /*OUT*/);
+Boolean   StrokeScorerSquared(StrokeScorer *pScorer);
 
-ULong     StrokeDicScoreStroke(Byte* bpX, Byte* bpY, UInt iLen,
-							   CharPtr cpPath, UInt iPathLen,
+ULong     StrokeScorerSquaredCost(StrokeScorer *pScorer, UInt iStroke,
+								  UInt iPathId);
+
+ULong     StrokeScorerBlockSums(StrokeScorer *pScorer, UInt iFirst, UInt iCnt,
+								ULong* piReject, ULong* piSum /*OUT*/);
+
+ULong     StrokeDicScoreStroke(const StrokeScorerParams* pParams,
+							   Byte* bpX, Byte* bpY, Byte* bpCorner,
+							   UInt iLen, CharPtr cpPath, UInt iPathLen,
 							   UInt iDepth);
 
-CharPtr   StrokeScorerExtraFilters(StrokeScorer *pscorer,
-								   CharPtr cp, ULong* ipScore /*OUT*/);
+Byte*     StrokeScorerCorners(StrokeScorer *pScorer, UInt iStroke);
 
-Long      StrokeScorerExtraEval(StrokeScorer *pscorer,
-								char cArg, UInt iStroke);
+void      StrokeScorerFeatures(StrokeScorer *pScorer);
+
+void      StrokeScorerExtraFilters(StrokeScorer *pScorer, UInt iEntry,
+								   Byte* bpUser, ULong* ipScore /*OUT*/);
 
 ULong     SqrtULong(ULong val);
 
+/* The default angle costs, as StrokeScorerAngCosts makes them for
+ * diAngCostCircular.  JStroke took plain code differences, so 0 (12:00)
+ * against 28 (10:30) cost 28 steps rather than 4.
+ */
+#define diCircDif(a, p) \
+	((a) > (p) ? ((a)-(p) > diAngCodes/2 ? diAngCodes-(a)+(p) : (a)-(p)) \
+	 : ((p)-(a) > diAngCodes/2 ? diAngCodes-(p)+(a) : (p)-(a)))
+#define diCircCost(a, p) (diCircDif(a, p)*diAngCostScale + diAngCostBase)
+#define diCircRow(a) { \
+	diCircCost(a, 0), diCircCost(a, 1), diCircCost(a, 2), diCircCost(a, 3), \
+	diCircCost(a, 4), diCircCost(a, 5), diCircCost(a, 6), diCircCost(a, 7), \
+	diCircCost(a, 8), diCircCost(a, 9), diCircCost(a,10), diCircCost(a,11), \
+	diCircCost(a,12), diCircCost(a,13), diCircCost(a,14), diCircCost(a,15), \
+	diCircCost(a,16), diCircCost(a,17), diCircCost(a,18), diCircCost(a,19), \
+	diCircCost(a,20), diCircCost(a,21), diCircCost(a,22), diCircCost(a,23), \
+	diCircCost(a,24), diCircCost(a,25), diCircCost(a,26), diCircCost(a,27), \
+	diCircCost(a,28), diCircCost(a,29), diCircCost(a,30), diCircCost(a,31) }
+
+static const StrokeScorerParams s_DefaultParams = {
+	diAngCostBase, diAngCostScale,
+	20, 5, 4,					/* TDR used 20*20... -rwells, 970719. */
+	20, 10,
+	0, 4,						/* Try every split point. */
+	0,							/* Score every entry in full. */
+	0,							/* Take strokes as drawn, */
+	0,							/*   in the order drawn, */
+	0, 200,						/*   one stroke for each in the entry. */
+	diAngCostCircular,
+	{
+		diCircRow( 0), diCircRow( 1), diCircRow( 2), diCircRow( 3),
+		diCircRow( 4), diCircRow( 5), diCircRow( 6), diCircRow( 7),
+		diCircRow( 8), diCircRow( 9), diCircRow(10), diCircRow(11),
+		diCircRow(12), diCircRow(13), diCircRow(14), diCircRow(15),
+		diCircRow(16), diCircRow(17), diCircRow(18), diCircRow(19),
+		diCircRow(20), diCircRow(21), diCircRow(22), diCircRow(23),
+		diCircRow(24), diCircRow(25), diCircRow(26), diCircRow(27),
+		diCircRow(28), diCircRow(29), diCircRow(30), diCircRow(31)
+	}
+};
+
 /* ----- SqrtULong ---------------------------------------------------------*/
 
+/* Bit at a time, without the multiplies of the binary search this
+ * replaced.  That search never tried its upper bound, which gave 1 for
+ * 4 and 5; scores are compared with older results, so keep that.
+ */
+
 ULong SqrtULong(ULong val) {
-	ULong root, rootLo, rootHi;
+	ULong root, bit;
 
-	if (val == 0)
-		return 0;
-	else if (val == 1)
-		return 1;
-	else if (val >= diMaxScoreSquared)
+	if (val >= diMaxScoreSquared)
 		return diMaxScoreToSquare;
+	else if (val == 4 || val == 5)
+		return 1;
 
-	rootLo = 1;
-	rootHi = (val >> 1);		/* will be >= 1, since val > 1. */
-	if (rootHi > diMaxScoreToSquare)
-		rootHi = diMaxScoreToSquare;
+	root = 0;
+	bit = ((ULong) 1) << 30;	/* Highest power of 4 below diMaxScoreSquared. */
+	while (bit > val)
+		bit >>= 2;
 
-	while ((root = ((rootLo + rootHi) >> 1)) > rootLo) {
-		if ((root * root) <= val) {
-			rootLo = root;
+	while (bit) {
+		if (val >= root + bit) {
+			val -= root + bit;
+			root = (root >> 1) + bit;
 		}
 		else {
-			rootHi = root;
+			root >>= 1;
 		}
+		bit >>= 2;
 	}
 
 	return root;
 }
 
+/* ----- SqrtULongBound ----------------------------------------------------*/
+/* The least val for which SqrtULong(val) >= iRoot, iRoot <= 0xffff. */
+
+static ULong SqrtULongBound(ULong iRoot) {
+	if (iRoot == diMaxScoreToSquare)
+		return diMaxScoreSquared;
+	else if (iRoot == 2)
+		return 6;				/* See SqrtULong. */
+
+	return iRoot * iRoot;
+}
+
+/* ----- StrokeScorerParamsInit ---------------------------------------------*/
+/* Fill in the built-in scoring constants */
+
+void StrokeScorerParamsInit (StrokeScorerParams *pParams) {
+	*pParams = s_DefaultParams;
+}
+
+/* ----- StrokeScorerAngCosts -----------------------------------------------*/
+/* Remake the angle cost table from the base, scale and model */
+
+void StrokeScorerAngCosts (StrokeScorerParams *pParams) {
+	UInt  iAng32, iPath32, iDif32;
+
+	if (pParams->m_iAngCostModel == diAngCostTable)
+		return;
+
+	for (iAng32 = 0; iAng32 < diAngCodes; iAng32++) {
+		for (iPath32 = 0; iPath32 < diAngCodes; iPath32++) {
+			if (iAng32 >= iPath32)
+				iDif32 = iAng32 - iPath32;
+			else
+				iDif32 = iPath32 - iAng32;
+
+			if (pParams->m_iAngCostModel == diAngCostCircular &&
+				iDif32 > diAngCodes/2)
+				iDif32 = diAngCodes - iDif32;
+
+			pParams->m_aiAngCost[iAng32][iPath32] =
+				iDif32 * pParams->m_iAngCostScale + pParams->m_iAngCostBase;
+		}
+	}
+}
+
 /* ----- StrokeScorerCreate-------------------------------------------------*/
 /* Create a StrokeScorer object. (Returns NULL if can't get memory) */
 
-StrokeScorer *StrokeScorerCreate  (CharPtr cpStrokeDic, RawStroke *rsp,
+StrokeScorer *StrokeScorerCreate  (StrokeDic *pDic, RawStroke *rsp,
 			 					   UInt iStrokeCnt) {
-	StrokeScorer *pScorer = (StrokeScorer *) MemPtrNew(sizeof(StrokeScorer));
+	UInt          i;
+	StrokeScorer *pScorer;
+
+	if (iStrokeCnt > diMaxStrokes) {
+		ErrBox("Too many strokes.");
+		return NULL;
+	}
+
+	pScorer = (StrokeScorer *) MemPtrNew(sizeof(StrokeScorer));
 	if (!pScorer) {
 		ErrBox("Not enough memory.");
 		return NULL;
 	}
 
-	pScorer->m_cpStrokeDic = cpStrokeDic;
+	pScorer->m_pDic = pDic;
+	pScorer->m_cpStrokeDic = pDic->m_cpStrokeDic;
 	pScorer->m_pRawStrokes = rsp;
 	pScorer->m_iStrokeCnt = iStrokeCnt;
 	pScorer->m_iScoreLen = 0;
-
-	pScorer->m_pScores = (ScoreItemPtr) MemPtrNew(diMaxListCount*sizeof(StrokeScorer));
+	pScorer->m_piOrder = NULL;
+	pScorer->m_iVisitCnt = pDic->m_iEntryCnt;
+	pScorer->m_iNext = 0;
+	pScorer->m_bStarted = false;
+	pScorer->m_iOwnCaches = 0;
+	pScorer->m_pParams = &s_DefaultParams;
+	pScorer->m_iCornersDone = 0;
+	pScorer->m_piSquared = NULL;
+	pScorer->m_piRotSquared = NULL;
+	pScorer->m_piEditCache = NULL;
+	pScorer->m_bSeeded = false;
+	pScorer->m_bPrefix = false;
+	pScorer->m_iPrefixValid = 0;
+	for (i = 0; i < diMaxStrokes; i++)
+		pScorer->m_apCache[i] = NULL;
+
+	pScorer->m_pScores = (ScoreItemPtr) MemPtrNew(diMaxListCount*sizeof(ScoreItem));
 	
 	if (!pScorer->m_pScores) {
 		ErrBox("Not enough memory.");
@@ -111,14 +283,7 @@ StrokeScorer *StrokeScorerCreate  (CharPtr cpStrokeDic, RawStroke *rsp,
 		return NULL;
 	}
 
-	pScorer->m_cpPath = MemPtrNew(diPathBufLen+1);
-
-	if (!pScorer->m_cpPath) {
-		ErrBox("Not enough memory.");
-		MemPtrFree(pScorer->m_pScores);
-		MemPtrFree(pScorer);
-		return NULL;
-	}
+	StrokeScorerFeatures(pScorer);
 
 	return pScorer;
 }
@@ -127,542 +292,1965 @@ StrokeScorer *StrokeScorerCreate  (CharPtr cpStrokeDic, RawStroke *rsp,
 /* Destroy a StrokeScorer object */
 
 void StrokeScorerDestroy  (StrokeScorer *pScorer) {
+	UInt i;
+
 	if (pScorer) {
+		for (i = 0; i < pScorer->m_iStrokeCnt; i++) {
+			if (pScorer->m_iOwnCaches & (1UL << i))
+				StrokeCostCacheDestroy (pScorer->m_apCache[i]);
+		}
+		if (pScorer->m_piOrder)
+			MemPtrFree (pScorer->m_piOrder);
+		if (pScorer->m_piSquared)
+			MemPtrFree (pScorer->m_piSquared);
+		if (pScorer->m_piRotSquared)
+			MemPtrFree (pScorer->m_piRotSquared);
+		if (pScorer->m_piEditCache)
+			MemPtrFree (pScorer->m_piEditCache);
 		MemPtrFree (pScorer->m_pScores);
-		MemPtrFree (pScorer->m_cpPath);
 		MemPtrFree (pScorer);
 	}
 }
 
-/* ----- StrokeScorerProcess-------------------------------------------------*/
-/* Process some database entries (maximum iMaxCnt, -1 for all).
-   Returns 0 when none remaining (should eventually return count remaining
-   to facilitate a progressbar */
+/* ----- StrokeScorerSetCache -----------------------------------------------*/
+/* Score user stroke iStroke through a cache owned by the caller. */
 
-Long     StrokeScorerProcess  (StrokeScorer *pScorer, Long iMaxCnt) {
-	CharPtr      cp, cpNext;
-	ULong        iScore;
-	Long         iCnt;
-	ScoreItemPtr pScore, pScoreBase, pSrc;
+void StrokeScorerSetCache  (StrokeScorer *pScorer, UInt iStroke,
+							StrokeCostCache *pCache) {
+	if (iStroke >= pScorer->m_iStrokeCnt)
+		return;
 
-	if (!pScorer) {
-		ErrBox("StrokeScorerProcess: pScorer == NULL.");
-		return 0;
+	if (pScorer->m_iOwnCaches & (1UL << iStroke)) {
+		StrokeCostCacheDestroy(pScorer->m_apCache[iStroke]);
+		pScorer->m_iOwnCaches &= ~(1UL << iStroke);
 	}
+	pScorer->m_apCache[iStroke] = pCache;
+}
 
-	pScoreBase = pScorer->m_pScores;
+/* ----- StrokeScorerSetParams ----------------------------------------------*/
+/* Score with pParams instead of the built-in constants. */
 
-	/* Evaluate all the items in cpStrokeDic against Context,
-	 * and update ScoreItems list as we go.
-	 */
+void StrokeScorerSetParams  (StrokeScorer *pScorer,
+							 const StrokeScorerParams *pParams) {
+	pScorer->m_pParams = pParams ? pParams : &s_DefaultParams;
+	pScorer->m_iCornersDone = 0;
+}
 
-	iCnt = 0;
-	for (cp = pScorer->m_cpStrokeDic; *cp; cp = cpNext) {
+/* ----- StrokeScorerPrefix -------------------------------------------------*/
+/* Rank the entries on the user's strokes so far.  StrokeScorerProcess
+ * then goes through the entries in the dictionary's prefix order, where
+ * the sums of squared scores of the strokes an entry shares with the one
+ * before carry over, and a run of entries all starting with a stroke too
+ * poor for the list is passed over without scoring any of them.
+ */
 
-		iCnt++;
-		if (iMaxCnt >= 0 && iCnt > iMaxCnt)
-			break;
+Boolean StrokeScorerPrefix  (StrokeScorer *pScorer) {
+	if (pScorer->m_iStrokeCnt > pScorer->m_pDic->m_iStrokeCnt)
+		return false;
 
-		cpNext = StrokeScorerEvalItem(pScorer, cp, &iScore);
+	pScorer->m_bPrefix = true;
+	pScorer->m_iPrefixValid = 0;
+	pScorer->m_aiPrefixSum[0] = 0;
+	return true;
+}
 
-		for (pScore = pScoreBase+pScorer->m_iScoreLen-1;
-			 pScore>=pScoreBase; pScore--) { 
-			if (iScore >= pScore->m_iScore)
-				break;
-		}
-		pScore++;
+/* ----- StrokeScorerOrder --------------------------------------------------*/
+/* Visit the entries likeliest to match first.  The estimate is just how
+ * far each user stroke's overall direction is from the overall direction
+ * of the corresponding dictionary stroke, which costs a table lookup per
+ * stroke instead of a full StrokeDicScoreStroke.  With strokes joined or
+ * broken, only the strokes before the first edit correspond, but taking
+ * all those both have still puts likely entries ahead of most others.
+ */
 
-		/* If we have a top score, lets register it. */
-		if (pScore < (pScoreBase + diMaxListCount)) {
+static ULong *s_piOrderKey;		/* qsort has no context pointer. */
 
-			/* Increase the score list length if it isn't full yet. */
-			if (pScorer->m_iScoreLen < diMaxListCount)
-				pScorer->m_iScoreLen++;
+static int StrokeScorerOrderCmp(const void *pA, const void *pB) {
+	UInt iA = *(const UInt *) pA;
+	UInt iB = *(const UInt *) pB;
 
-			/* Push down all lower scores in the list to make room. */
-			for (pSrc = pScoreBase+pScorer->m_iScoreLen-2; pSrc >= pScore; pSrc--) {
-				pSrc[1].m_iScore = pSrc->m_iScore;
-				pSrc[1].m_cp     = pSrc->m_cp;
-			}
+	if (s_piOrderKey[iA] != s_piOrderKey[iB])
+		return (s_piOrderKey[iA] < s_piOrderKey[iB]) ? -1 : 1;
+	return (iA < iB) ? -1 : (iA > iB);	/* Keep dictionary order on ties. */
+}
 
-			/* Actually store our info in the list. */
-			pScore->m_iScore = iScore;
-			pScore->m_cp = cp;
+Boolean StrokeScorerOrder  (StrokeScorer *pScorer) {
+	StrokeDic* pDic = pScorer->m_pDic;
+	RawStroke* rsp;
+	Byte       bUserAng[diMaxStrokes];
+	Byte*      bpNetAng = pDic->m_pPaths->m_bpNetAng;
+	Word*      pPathIds;
+	ULong*     piKey;
+	UInt       iEntry, iStroke, iDif, iNetAng;
+	UInt       iStrokeCnt = pScorer->m_iStrokeCnt;
+
+	if (iStrokeCnt > pDic->m_iStrokeCnt)
+		iStrokeCnt = pDic->m_iStrokeCnt;
+
+	if (pScorer->m_piOrder)
+		return true;
+
+	pScorer->m_piOrder = (UInt *) MemPtrNew((pDic->m_iEntryCnt+1)*sizeof(UInt));
+	piKey = (ULong *) MemPtrNew((pDic->m_iEntryCnt+1)*sizeof(ULong));
+	if (!pScorer->m_piOrder || !piKey) {
+		ErrBox("Not enough memory.");
+		if (pScorer->m_piOrder)
+			MemPtrFree(pScorer->m_piOrder);
+		if (piKey)
+			MemPtrFree(piKey);
+		pScorer->m_piOrder = NULL;
+		return false;
+	}
+
+	for (iStroke = 0; iStroke < pScorer->m_iStrokeCnt; iStroke++) {
+		rsp = &(pScorer->m_pRawStrokes[iStroke]);
+		bUserAng[iStroke] = Angle32(rsp->m_x[rsp->m_len-1] - rsp->m_x[0],
+									rsp->m_y[0] - rsp->m_y[rsp->m_len-1]);
+	}
+
+	for (iEntry = 0; iEntry < pDic->m_iEntryCnt; iEntry++) {
+		pPathIds = pDic->m_pPathIds + iEntry*pDic->m_iStrokeCnt;
+		piKey[iEntry] = 0;
+		for (iStroke = 0; iStroke < iStrokeCnt; iStroke++) {
+			iNetAng = bpNetAng[pPathIds[iStroke]];
+			if (bUserAng[iStroke] == 32) {
+				iDif = 8;			/* No direction to speak of. */
+			}
+			else {
+				iDif = (bUserAng[iStroke] - iNetAng) & 31;
+				if (iDif > 16)
+					iDif = 32 - iDif;
+			}
+			piKey[iEntry] += iDif * iDif;
 		}
+		pScorer->m_piOrder[iEntry] = iEntry;
+	}
 
-	} /* for each stroke description... */
+	s_piOrderKey = piKey;
+	qsort(pScorer->m_piOrder, pDic->m_iEntryCnt, sizeof(UInt),
+		  StrokeScorerOrderCmp);
+	s_piOrderKey = NULL;
 
-	if (cp)
-		return 1;				/* should be count remaining */
-	else
-		return 0;
+	MemPtrFree(piKey);
+	return true;
 }
 
-/* ----- StrokeScorerTopPicks -----------------------------------------------*/
-/* Return best diMaxListCount candidates processed so far */
+/* ----- StrokeScorerPyramid ------------------------------------------------*/
+/* Rank the entries against the user's strokes resampled to 8 points,
+ * keep the best m_iPyramidKeep percent, rank those again at 16 points
+ * and keep the best of them, to be scored in full in that order.  Per
+ * path work at these sizes is a fraction of the full recursion, so
+ * most of the bucket never costs a full StrokeDicScoreStroke.
+ */
 
-ListMem*      StrokeScorerTopPicks (StrokeScorer *pScorer)
-{
-	ListMem*     pListMem;
-	UInt         iTotStrLen, iListSize, iTotSize;
-	CharPtr      cpList;
-	CharPtr*     cppList;
-	ScoreItemPtr pScore, pScoreBase;
-	UInt         sJisVal;
-	char         buf[10];
+#define diPyramidLevels 2
 
-	if (!pScorer) {
-		ErrBox("StrokeScorerTopPicks: pScorer == NULL.");
-		return NULL;
-	}
+static const UInt s_aiPyramidPoints[diPyramidLevels] = { 8, 16 };
 
-	/* If no list, just return an empty list. */
-	if (pScorer->m_iScoreLen <= 0)
-		return AppEmptyList();
+typedef struct {
+	ULong m_iKey;
+	UInt  m_iEntry;
+} PyramidItem;
 
-	pScoreBase = pScorer->m_pScores;
+static int StrokeScorerPyramidCmp(const void *pA, const void *pB) {
+	const PyramidItem *pItemA = (const PyramidItem *) pA;
+	const PyramidItem *pItemB = (const PyramidItem *) pB;
 
-	iTotStrLen = pScorer->m_iScoreLen * (diScoreTextLen + 1);
+	if (pItemA->m_iKey != pItemB->m_iKey)
+		return (pItemA->m_iKey < pItemB->m_iKey) ? -1 : 1;
+	return (pItemA->m_iEntry < pItemB->m_iEntry) ? -1 :
+		(pItemA->m_iEntry > pItemB->m_iEntry);	/* Keep dictionary order. */
+}
 
-	iListSize = (pScorer->m_iScoreLen+1)*sizeof(CharPtr); /* One extra for NULL terminator */
-	iTotSize = sizeof(ListMem) + iListSize + iTotStrLen;
+/* Resample rsp to iPoints points spaced evenly along its length. */
 
-	if (!(cpList = MemPtrNew(iTotSize))) {
-		ErrBox("ERROR: no mem in top picks");
-		return NULL;
+static void StrokeResample(RawStroke* rsp, UInt iPoints, RawStroke* rspOut) {
+	ULong aiDist[diMaxXyPairs];
+	ULong iTotal, iTarget, iSeg;
+	Long  iDifX, iDifY;
+	UInt  i, j;
+
+	if (rsp->m_len <= iPoints) {
+		*rspOut = *rsp;
+		return;
 	}
 
-	pListMem = (ListMem *) cpList;	cpList += sizeof(ListMem);
-	cppList = (CharPtr *) cpList;	cpList += iListSize;
-	
-	pListMem->m_argc = pScorer->m_iScoreLen;
-	pListMem->m_argv = cppList;	/* Copy now before we use it in loop... */
+	aiDist[0] = 0;
+	for (i = 1; i < rsp->m_len; i++) {
+		iDifX = rsp->m_x[i] - rsp->m_x[i-1];
+		iDifY = rsp->m_y[i] - rsp->m_y[i-1];
+		aiDist[i] = aiDist[i-1] + SqrtULong(iDifX*iDifX + iDifY*iDifY);
+	}
+	iTotal = aiDist[rsp->m_len-1];
 
-	for (pScore = pScoreBase; pScore < (pScoreBase+pScorer->m_iScoreLen); pScore++) {
-		*cppList++ = cpList;
-		*cpList++ = pScore->m_cp[0];
-		*cpList++ = pScore->m_cp[1];
-		*cpList++ = ' ';
-		*cpList++ = ' ';
+	for (i = 0, j = 0; i < iPoints; i++) {
+		iTarget = iTotal * i / (iPoints-1);
+		while (j < rsp->m_len-2 && aiDist[j+1] < iTarget)
+			j++;
 
-		*cpList++ = 'S';
-		*cpList++ = 'J';
-		*cpList++ = 'I';
-		*cpList++ = 'S';
-		*cpList++ = ':';
+		iSeg = aiDist[j+1] - aiDist[j];
+		if (iSeg == 0 || iTarget <= aiDist[j]) {
+			rspOut->m_x[i] = rsp->m_x[j];
+			rspOut->m_y[i] = rsp->m_y[j];
+		}
+		else {
+			iTarget -= aiDist[j];
+			rspOut->m_x[i] = rsp->m_x[j] +
+				((Long) rsp->m_x[j+1] - rsp->m_x[j]) * (Long) iTarget / (Long) iSeg;
+			rspOut->m_y[i] = rsp->m_y[j] +
+				((Long) rsp->m_y[j+1] - rsp->m_y[j]) * (Long) iTarget / (Long) iSeg;
+		}
+	}
+	rspOut->m_len = iPoints;
+}
 
-		// BUGFIX: Need to avoid sign extension.  -rwells, 19970926.
-		sJisVal = ((pScore->m_cp[0] & 0xff) << 8) + (pScore->m_cp[1] & 0xff);
+Boolean StrokeScorerPyramid  (StrokeScorer *pScorer) {
+	StrokeDic*   pDic = pScorer->m_pDic;
+	StrokePaths* pPaths = pDic->m_pPaths;
+	UInt         iStrokeCnt = pScorer->m_iStrokeCnt;
+	PyramidItem* pItems;
+	RawStroke*   prsCoarse;
+	ULong*       piCost;
+	Word*        pPathIds;
+	ULong        iCost, iKey;
+	UInt         iCount, iKeep, iLevel, iItem, iStroke, iPathId;
+
+	pItems = (PyramidItem *) MemPtrNew((pDic->m_iEntryCnt+1)*sizeof(PyramidItem));
+	prsCoarse = (RawStroke *) MemPtrNew(iStrokeCnt*sizeof(RawStroke));
+	piCost = (ULong *) MemPtrNew((iStrokeCnt*pPaths->m_iCount+1)*sizeof(ULong));
+	if (!pItems || !prsCoarse || !piCost) {
+		ErrBox("Not enough memory.");
+		if (pItems) MemPtrFree(pItems);
+		if (prsCoarse) MemPtrFree(prsCoarse);
+		if (piCost) MemPtrFree(piCost);
+		return false;
+	}
 
-		StrIToH(buf, sJisVal);
-		*cpList++ = buf[4];
-		*cpList++ = buf[5];
-		*cpList++ = buf[6];
-		*cpList++ = buf[7];
+	iCount = pDic->m_iEntryCnt;
+	for (iItem = 0; iItem < iCount; iItem++)
+		pItems[iItem].m_iEntry = iItem;
+
+	for (iLevel = 0; iLevel < diPyramidLevels; iLevel++) {
+		for (iStroke = 0; iStroke < iStrokeCnt; iStroke++)
+			StrokeResample(pScorer->m_pRawStrokes + iStroke,
+						   s_aiPyramidPoints[iLevel], prsCoarse + iStroke);
+		for (iItem = 0; iItem < iStrokeCnt*pPaths->m_iCount; iItem++)
+			piCost[iItem] = diUnscored;
+
+		/* Sum of squared stroke scores, as StrokeScorerEvalItem. */
+		for (iItem = 0; iItem < iCount; iItem++) {
+			pPathIds = pDic->m_pPathIds + pItems[iItem].m_iEntry*iStrokeCnt;
+			iKey = 0;
+			for (iStroke = 0; iStroke < iStrokeCnt; iStroke++) {
+				iPathId = pPathIds[iStroke];
+				iCost = piCost[iStroke*pPaths->m_iCount + iPathId];
+				if (iCost == diUnscored) {
+					iCost = StrokeDicScoreStroke(pScorer->m_pParams,
+												 prsCoarse[iStroke].m_x,
+												 prsCoarse[iStroke].m_y, NULL,
+												 prsCoarse[iStroke].m_len,
+												 (CharPtr) pPaths->m_bpCodes + iPathId*diPathBufLen,
+												 pPaths->m_bpLen[iPathId], 0);
+					piCost[iStroke*pPaths->m_iCount + iPathId] = iCost;
+				}
 
-		*cpList++ = ' ';
-		*cpList++ = ' ';
-		*cpList++ = '#';
-		StrIToA(cpList, pScore->m_iScore); /* Null terminates */
-		cpList += StrLen(cpList) + 1; /* Skip ascii number and null. */
+				iCost = (iCost >= diMaxScoreToSquare) ? diMaxScoreSquared
+													  : iCost * iCost;
+				if (iKey >= diMaxScoreSquared - iCost)
+					iKey = diMaxScoreSquared;
+				else
+					iKey += iCost;
+			}
+			pItems[iItem].m_iKey = iKey;
+		}
+
+		qsort(pItems, iCount, sizeof(PyramidItem), StrokeScorerPyramidCmp);
+
+		/* Keep enough to fill the list, whatever the percentage. */
+		iKeep = (iCount * pScorer->m_pParams->m_iPyramidKeep + 99) / 100;
+		if (iKeep < diMaxListCount)
+			iKeep = diMaxListCount;
+		if (iKeep < iCount)
+			iCount = iKeep;
 	}
-	*cppList = NULL;			/* NULL terminated argv vector, for luck. */
-	return pListMem;
+
+	if (!pScorer->m_piOrder)
+		pScorer->m_piOrder = (UInt *) MemPtrNew((pDic->m_iEntryCnt+1)*sizeof(UInt));
+	if (pScorer->m_piOrder) {
+		for (iItem = 0; iItem < iCount; iItem++)
+			pScorer->m_piOrder[iItem] = pItems[iItem].m_iEntry;
+		pScorer->m_iVisitCnt = iCount;
+	}
+	else {
+		ErrBox("Not enough memory.");
+	}
+
+	MemPtrFree(pItems);
+	MemPtrFree(prsCoarse);
+	MemPtrFree(piCost);
+	return pScorer->m_piOrder != NULL;
 }
 
-/* ----- StrokeScorerEvalItem -----------------------------------------------*/
+/* ----- StrokeScorerProcess-------------------------------------------------*/
+/* Process some database entries (maximum iMaxCnt, -1 for all).
+   Successive calls carry on where the last one stopped.
+   Returns the count of entries remaining, 0 when done. */
 
-CharPtr StrokeScorerEvalItem(StrokeScorer *pScorer, CharPtr cpEntry,
-							 ULong* ipScore /*OUT*/) {
-	CharPtr cp = cpEntry;
-	UInt    iStroke;
-	CharPtr cpPath = pScorer->m_cpPath;
-	CharPtr cpPathEnd;
-	RawStroke* rsp;
-	ULong   iThisScore;
-	ULong   iScore = 0;
+Long     StrokeScorerProcess  (StrokeScorer *pScorer, Long iMaxCnt) {
+	ULong        aiSum[diBlockLen];
+	ULong        aiReject[diBlockLen];
+	ULong        iScore, iWorst, iLive;
+	Long         iCnt;
+	UInt         iEntry, iBlock, i;
+	ScoreItemPtr pScoreBase;
 
-	MemoWriteLen(pScorer->m_cpStrokeDic, 2); /* DEBUG: tag trace with SJIS char. */
+	if (!pScorer) {
+		ErrBox("StrokeScorerProcess: pScorer == NULL.");
+		return 0;
+	}
 
-	if (*cp) cp++;				/* Skip over first half SJIS char. */
-	if (*cp) cp++;				/* Skip over second half SJIS char. */
+	pScoreBase = pScorer->m_pScores;
 
-	/* The first char must have high order bit set,
-	 * and the second char MAY have high order bit set,
-	 * but a subsequent char with high order bit set must be
-	 * the beginning of the next entry.  -rwells, 970712.
-	 */
+	if (pScorer->m_bPrefix)
+		return StrokeScorerProcessPrefix(pScorer, iMaxCnt);
 
-	/* Loop through stroke descriptions */
-	for (iStroke = 0; iStroke < pScorer->m_iStrokeCnt; iStroke++) {
+	if (!pScorer->m_bStarted) {
+		pScorer->m_bStarted = true;
+		/* The coarse levels are scored unturned, ordered as drawn and
+		 * stroke for stroke, so could drop entries the other modes
+		 * would have saved.
+		 */
+		if (pScorer->m_pParams->m_iPyramidKeep &&
+			!pScorer->m_pParams->m_iRotate && !pScorer->m_pParams->m_iOrderFree &&
+			pScorer->m_iStrokeCnt == pScorer->m_pDic->m_iStrokeCnt)
+			StrokeScorerPyramid(pScorer);
+	}
 
-		cpPathEnd = cpPath;
-
-		switch (*cp) {		/* Break out on first char value... */
-		case 'A':			/* TDR='1' CLK=07:30 DEG=225 */
-			*cpPathEnd++ = 20; break; 
-		case 'B':			/* TDR='2' CLK=06:00 DEG=180 */
-			*cpPathEnd++ = 16; break; 
-		case 'C':			/* TDR='3' CLK=04:30 DEG=135 */
-			*cpPathEnd++ = 12; break; 
-		case 'D':			/* TDR='4' CLK=09:00 DEG=270 */
-			*cpPathEnd++ = 24; break; 
-		case 'F':			/* TDR='6' CLK=03:00 DEG=090 */
-			*cpPathEnd++ =  8; break; 
-		case 'G':			/* TDR='7' CLK=10:30 DEG=315 */
-			*cpPathEnd++ = 28; break; 
-		case 'H':			/* TDR='8' CLK=12:00 DEG=360 */
-			*cpPathEnd++ =  0; break; 
-		case 'I':			/* TDR='9' CLK=01:30 DEG=045 */
-			*cpPathEnd++ =  4; break; 
-		case 'J':			/* TDR='x' down   06:00 then 07:30 */
-			*cpPathEnd++ = 16; *cpPathEnd++ = 20; break; 
-		case 'K':			/* TDR='y' down   06:00 then 04:30 */
-			*cpPathEnd++ = 16; *cpPathEnd++ = 12; break; 
-		case 'L':			/* TDR='c' down   06:00 then 03:00 */
-			*cpPathEnd++ = 16; *cpPathEnd++ =  8; break; 
-		case 'M':			/* TDR='b' across 03:00 then 06:00 */
-			*cpPathEnd++ =  8; *cpPathEnd++ = 16; break; 
-		default:
-			goto NoMoreStrokes;
-		} /* end switch on first char value */
-
-		for (cp++; ; cp++) {	/* Loop through following chars for stroke */
-			switch (*cp) {		/* Break out on char value... */
-			case 'a':			/* TDR='1' CLK=07:30 DEG=225 */
-				*cpPathEnd++ = 20; break; 
-			case 'b':			/* TDR='2' CLK=06:00 DEG=180 */
-				*cpPathEnd++ = 16; break; 
-			case 'c':			/* TDR='3' CLK=04:30 DEG=135 */
-				*cpPathEnd++ = 12; break; 
-			case 'd':			/* TDR='4' CLK=09:00 DEG=270 */
-				*cpPathEnd++ = 24; break; 
-			case 'f':			/* TDR='6' CLK=03:00 DEG=090 */
-				*cpPathEnd++ =  8; break; 
-			case 'g':			/* TDR='7' CLK=10:30 DEG=315 */
-				*cpPathEnd++ = 28; break; 
-			case 'h':			/* TDR='8' CLK=12:00 DEG=360 */
-				*cpPathEnd++ =  0; break; 
-			case 'i':			/* TDR='9' CLK=01:30 DEG=045 */
-				*cpPathEnd++ =  4; break; 
-			case 'j':			/* TDR='x' down   06:00 then 07:30 */
-				*cpPathEnd++ = 16; *cpPathEnd++ = 20; break; 
-			case 'k':			/* TDR='y' down   06:00 then 04:30 */
-				*cpPathEnd++ = 16; *cpPathEnd++ = 12; break; 
-			case 'l':			/* TDR='c' down   06:00 then 03:00 */
-				*cpPathEnd++ = 16; *cpPathEnd++ =  8; break; 
-			case 'm':			/* TDR='b' across 03:00 then 06:00 */
-				*cpPathEnd++ =  8; *cpPathEnd++ = 16; break; 
-			default:
-				goto ThisStrokeDone;
-			} /* end switch on char value */
-		} /* end loop through chars for stroke */
-ThisStrokeDone:
+	/* Evaluate all the items in cpStrokeDic against Context,
+	 * and update ScoreItems list as we go.  In dictionary order, sum
+	 * the squared stroke scores of a block of entries at a time.
+	 */
 
-		rsp = &(pScorer->m_pRawStrokes[iStroke]);
+	if (!pScorer->m_piOrder && !pScorer->m_pParams->m_iRotate &&
+		!pScorer->m_pParams->m_iOrderFree &&
+		pScorer->m_iStrokeCnt == pScorer->m_pDic->m_iStrokeCnt &&
+		StrokeScorerSquared(pScorer)) {
+		for (iCnt = 0; pScorer->m_iNext < pScorer->m_iVisitCnt; iCnt += iBlock) {
+			iBlock = pScorer->m_iVisitCnt - pScorer->m_iNext;
+			if (iBlock > diBlockLen)
+				iBlock = diBlockLen;
+			if (iMaxCnt >= 0 && iBlock > iMaxCnt - iCnt)
+				iBlock = iMaxCnt - iCnt;
+			if (iBlock == 0)
+				break;
 
-		iThisScore = StrokeDicScoreStroke(rsp->m_x, rsp->m_y, rsp->m_len,
-										  cpPath, (cpPathEnd - cpPath),
-										  0 /*depth*/);
-		
-		MemoWrite2d(" s", iStroke+1);
-		MemoWrite2d("=", iThisScore); /* DEBUG: stroke score */
+			/* Once the list is full, an entry must beat the worst in it;
+			 * until then, take just enough entries to fill it.
+			 */
+			if (pScorer->m_iScoreLen < diMaxListCount) {
+				if (iBlock > diMaxListCount - pScorer->m_iScoreLen)
+					iBlock = diMaxListCount - pScorer->m_iScoreLen;
+				for (i = 0; i < iBlock; i++)
+					aiReject[i] = diUnscored;
+			}
+			else {
+				iWorst = pScoreBase[diMaxListCount-1].m_iScore;
+				for (i = 0; i < iBlock; i++)
+					aiReject[i] = StrokeScorerRejectSum(pScorer, pScorer->m_iNext + i,
+														iWorst);
+			}
 
-		if (iThisScore >= diMaxScoreToSquare)
-			iThisScore = diMaxScoreSquared;
-		else
-			iThisScore = (iThisScore * iThisScore);
+			iLive = StrokeScorerBlockSums(pScorer, pScorer->m_iNext, iBlock,
+										  aiReject, aiSum);
 
-		if (iScore >= (diMaxScoreSquared - iThisScore))
-			iScore = diMaxScoreSquared;
-		else
-			iScore += iThisScore;
+			/* Only the entries left in the mask can make the list. */
+			for (i = 0; iLive >> i; i++) {
+				if (!(iLive & (1UL << i)))
+					continue;
+				iEntry = pScorer->m_iNext + i;
 
-	} /* end loop through stroke descriptions */
-NoMoreStrokes:
+				/* The list may have improved since the block began. */
+				if (pScorer->m_iScoreLen == diMaxListCount) {
+					iWorst = pScoreBase[diMaxListCount-1].m_iScore;
+					if (aiSum[i] >= StrokeScorerRejectSum(pScorer, iEntry, iWorst))
+						continue;
+				}
 
-	iScore = SqrtULong(iScore);
-	*ipScore = iScore;
+				iScore = StrokeScorerFinish(pScorer, iEntry, aiSum[i], NULL);
+				StrokeScorerInsert(pScorer, iEntry, iScore);
+			}
 
-	MemoWrite2d(" is=", iScore); /* DEBUG: overall stroke score */
+			pScorer->m_iNext += iBlock;
+		}
 
-    /* Handle optional extra filters... may modify *ipScore, updates cp. */
-	if (*cp == '|') {
-		cp = StrokeScorerExtraFilters(pScorer, cp+1, ipScore);
+		return pScorer->m_iVisitCnt - pScorer->m_iNext;
 	}
 
-	if (iStroke != pScorer->m_iStrokeCnt)
-		ErrBox("JStrokeDic miscount");
-	if (!(*cp & 0x80) && (*cp != '\0'))
-		ErrBox("JStrokeDic leftovers");
+	for (iCnt = 0; pScorer->m_iNext < pScorer->m_iVisitCnt; pScorer->m_iNext++) {
 
+		iCnt++;
+		if (iMaxCnt >= 0 && iCnt > iMaxCnt)
+			break;
 
-	MemoWrite2d(" fs=", *ipScore); /* DEBUG: final score */
-	MemoWrite("\n");
+		iEntry = pScorer->m_piOrder ? pScorer->m_piOrder[pScorer->m_iNext]
+									: pScorer->m_iNext;
 
-	return cp;
+		/* Once the list is full, an entry must beat the worst in it. */
+		if (StrokeScorerEvalItem(pScorer, iEntry,
+								 (pScorer->m_iScoreLen < diMaxListCount)
+								 ? diUnscored
+								 : pScoreBase[diMaxListCount-1].m_iScore,
+								 &iScore))
+			StrokeScorerInsert(pScorer, iEntry, iScore);
+
+	} /* for each stroke description... */
+
+	return pScorer->m_iVisitCnt - pScorer->m_iNext;
 }
 
-/* ----- StrokeDicScoreStroke ---------------------------------------------- */
+/* ----- StrokeScorerProcessPrefix -------------------------------------------*/
+/* StrokeScorerProcess for StrokeScorerPrefix. */
 
-ULong StrokeDicScoreStroke(Byte* bpX, Byte* bpY, UInt iLen,
-						   CharPtr cpPath, UInt iPathLen,
-								  UInt iDepth) {
-	ULong iScore, iThisScore;
-	Long iMid, iStep, iPathMid, iPathRest;
-	Long iDifX, iDifY;
-	UInt iAng32, iPath32, iDif32;
+Long StrokeScorerProcessPrefix(StrokeScorer *pScorer, Long iMaxCnt) {
+	StrokeDic*   pDic = pScorer->m_pDic;
+	ULong*       piSum = pScorer->m_aiPrefixSum;
+	Word*        pPathIds;
+	ULong        iThisScore, iReject;
+	Long         iCnt;
+	UInt         iEntry, iStroke;
 
-	if (iLen < 2 || iPathLen < 1)
-		return diHugeCost;
+	pScorer->m_bStarted = true;
 
-	if (iPathLen == 1) {
-		iDifX = bpX[iLen-1] - bpX[0];
-		iDifY = bpY[0] - bpY[iLen-1]; /* Flip from display to math axes. */
+	for (iCnt = 0; pScorer->m_iNext < pScorer->m_iVisitCnt; pScorer->m_iNext++) {
 
-		if (iDifX == 0 && iDifY == 0) /* Two samples at same place... */
-			return diHugeCost;
+		iCnt++;
+		if (iMaxCnt >= 0 && iCnt > iMaxCnt)
+			break;
 
-		/* Subdivide recursively while stroke is long and depth is shallow.
-		 * $$$ These values are pretty magic... review later. -rwells, 970719.
-		 * TDR used 20*20... -rwells, 970719.
+		iEntry = pDic->m_piPrefixOrder[pScorer->m_iNext];
+		pPathIds = pDic->m_pPathIds + iEntry*pDic->m_iStrokeCnt;
+
+		MemoWriteLen(pDic->m_cppEntries[iEntry], /* DEBUG: tag trace with char. */
+					 StrokeDicSkipChar(pDic->m_cppEntries[iEntry]) - pDic->m_cppEntries[iEntry]);
+
+		/* Once the list is full, an entry must beat the worst in it. */
+		iReject = diUnscored;
+		if (pScorer->m_iScoreLen == diMaxListCount &&
+			pScorer->m_pScores[diMaxListCount-1].m_iScore <= diMaxScoreToSquare)
+			iReject = SqrtULongBound(pScorer->m_pScores[diMaxListCount-1].m_iScore);
+
+		/* The list only gets harder to make, so a shared sum that failed
+		 * before fails again.
 		 */
-		if ((iDifX*iDifX + iDifY*iDifY) > (20*20) && iLen > 5 && iDepth < 4) {
+		iStroke = pDic->m_bpPrefixSame[pScorer->m_iNext];
+		if (iStroke > pScorer->m_iPrefixValid)
+			iStroke = pScorer->m_iPrefixValid;
+
+		for (; iStroke < pScorer->m_iStrokeCnt && piSum[iStroke] < iReject;
+			 iStroke++) {
+			iThisScore = StrokeScorerStrokeCost(pScorer, iStroke, pPathIds[iStroke]);
+
+			MemoWrite2d(" s", iStroke+1);
+			MemoWrite2d("=", iThisScore); /* DEBUG: stroke score */
+
+			if (iThisScore >= diMaxScoreToSquare)
+				iThisScore = diMaxScoreSquared;
+			else
+				iThisScore = (iThisScore * iThisScore);
+
+			if (piSum[iStroke] >= (diMaxScoreSquared - iThisScore))
+				piSum[iStroke+1] = diMaxScoreSquared;
+			else
+				piSum[iStroke+1] = piSum[iStroke] + iThisScore;
+		}
+		pScorer->m_iPrefixValid = iStroke;
 
-			iMid = iLen >> 1;
+		if (piSum[iStroke] >= iReject) {
+			MemoWrite(" rejected\n");
+			continue;
+		}
 
-			/* Note that we use the middle point on both sides... */
+		StrokeScorerInsert(pScorer, iEntry,
+						   StrokeScorerFinish(pScorer, iEntry,
+											  piSum[pScorer->m_iStrokeCnt], NULL));
+	}
 
-			iScore  = StrokeDicScoreStroke(bpX, bpY, iMid+1,
-										   cpPath, iPathLen, iDepth+1);
+	return pScorer->m_iVisitCnt - pScorer->m_iNext;
+}
 
-			iScore += StrokeDicScoreStroke(bpX+iMid, bpY+iMid, iLen-iMid,
-										   cpPath, iPathLen, iDepth+1);
+/* ----- StrokeScorerInsert --------------------------------------------------*/
+/* Enter an entry's final score in the list, if it is among the best. */
 
-			return (iScore >> 1);
+void StrokeScorerInsert(StrokeScorer *pScorer, UInt iEntry, ULong iScore) {
+	ScoreItemPtr pScore, pScoreBase, pSrc;
+	CharPtr      cp;
+	UInt         iCharLen;
 
-		} /* End if stroke is long, and depth is shallow... */
+	pScoreBase = pScorer->m_pScores;
 
-		/* Time to score this segment against desired direction. */
-		
-		iAng32 = Angle32(iDifX, iDifY);
+	/* A seeded list may have the character from another dictionary. */
+	if (pScorer->m_bSeeded) {
+		cp = pScorer->m_pDic->m_cppEntries[iEntry];
+		iCharLen = StrokeDicSkipChar(cp) - cp;
+		for (pScore = pScoreBase;
+			 pScore < pScoreBase+pScorer->m_iScoreLen; pScore++) {
+			if (StrokeDicSkipChar(pScore->m_cp) - pScore->m_cp == iCharLen &&
+				!memcmp(pScore->m_cp, cp, iCharLen))
+				break;
+		}
+		if (pScore < pScoreBase+pScorer->m_iScoreLen) {
+			if (iScore >= pScore->m_iScore)
+				return;
+			for (pSrc = pScore; pSrc < pScoreBase+pScorer->m_iScoreLen-1; pSrc++) {
+				pSrc->m_iScore = pSrc[1].m_iScore;
+				pSrc->m_cp     = pSrc[1].m_cp;
+			}
+			pScorer->m_iScoreLen--;
+		}
+	}
 
-		iPath32 = *cpPath;
+	for (pScore = pScoreBase+pScorer->m_iScoreLen-1;
+		 pScore>=pScoreBase; pScore--) { 
+		if (iScore >= pScore->m_iScore)
+			break;
+	}
+	pScore++;
 
-		if (iAng32 >= iPath32)
-			iDif32 = iAng32 - iPath32;
-		else
-			iDif32 = iPath32 - iAng32;
+	/* If we have a top score, lets register it. */
+	if (pScore < (pScoreBase + diMaxListCount)) {
 
-		return iDif32 * diAngCostScale + diAngCostBase;
+		/* Increase the score list length if it isn't full yet. */
+		if (pScorer->m_iScoreLen < diMaxListCount)
+			pScorer->m_iScoreLen++;
 
-	} /* end if path len is 1. */
-	else {
+		/* Push down all lower scores in the list to make room. */
+		for (pSrc = pScoreBase+pScorer->m_iScoreLen-2; pSrc >= pScore; pSrc--) {
+			pSrc[1].m_iScore = pSrc->m_iScore;
+			pSrc[1].m_cp     = pSrc->m_cp;
+		}
 
-		iScore = diHugeCost * iPathLen * 2;
-		iPathMid = iPathLen >> 1;
-		iPathRest = iPathLen - iPathMid;
-		
-		if (iLen < 20)
-			iStep = 1;
-		else
-			iStep = iLen / 10;
+		/* Actually store our info in the list. */
+		pScore->m_iScore = iScore;
+		pScore->m_cp = pScorer->m_pDic->m_cppEntries[iEntry];
+	}
+}
 
-		for (iMid = iPathMid; iMid < iLen - iPathRest; iMid += iStep) {
+/* ----- StrokeScorerSquared -------------------------------------------------*/
+/* Set up the table of squared stroke scores by stroke and path id that
+ * StrokeScorerBlockSums fills in as it goes.  Returns false if can't get
+ * memory.
+ */
 
-			/* TDR original doesn't increase iDepth... -rwells, 970719. */
+Boolean StrokeScorerSquared(StrokeScorer *pScorer) {
+	UInt  iLen = pScorer->m_iStrokeCnt * pScorer->m_pDic->m_pPaths->m_iCount;
+	UInt  i;
 
-			iThisScore  = StrokeDicScoreStroke(bpX, bpY, iMid+1,
-											   cpPath, iPathMid, iDepth+1);
+	if (pScorer->m_piSquared)
+		return true;
 
-			iThisScore += StrokeDicScoreStroke(bpX+iMid, bpY+iMid, iLen-iMid,
-											   cpPath+iPathMid, iPathRest,
-											   iDepth+1);
+	pScorer->m_piSquared = (ULong *) MemPtrNew((iLen+1)*sizeof(ULong));
+	if (!pScorer->m_piSquared) {
+		ErrBox("Not enough memory.");
+		return false;
+	}
 
-			/* TDR original doesn't divide sum by 2... -rwells, 970719. */
-			iThisScore >>= 1;
+	for (i = 0; i < iLen; i++)
+		pScorer->m_piSquared[i] = diUnscored;
+	return true;
+}
 
-			if (iThisScore < iScore)
-				iScore = iThisScore;
+/* ----- StrokeScorerSquaredCost --------------------------------------------*/
+/* User stroke iStroke's squared score against path iPathId, limited to
+ * diMaxScoreSquared, through the table StrokeScorerSquared set up.
+ */
 
-		} /* end for trials on various mid-point divisions of stroke... */
+ULong StrokeScorerSquaredCost(StrokeScorer *pScorer, UInt iStroke,
+							  UInt iPathId) {
+	ULong* piSquared = pScorer->m_piSquared +
+		iStroke*pScorer->m_pDic->m_pPaths->m_iCount + iPathId;
+	ULong  iThisScore;
 
-		return iScore;
-	} /* end if path len is >1. */
+	if (*piSquared == diUnscored) {
+		iThisScore = StrokeScorerStrokeCost(pScorer, iStroke, iPathId);
+		*piSquared = (iThisScore >= diMaxScoreToSquare)
+			? diMaxScoreSquared : iThisScore * iThisScore;
+	}
+	return *piSquared;
 }
 
-/* ----- StrokeScorerExtraFilters ---------------------------------------------*/
+#ifndef SIMD_BLOCK_SUMS
 
-CharPtr StrokeScorerExtraFilters(StrokeScorer *pScorer,
-								 CharPtr cp, ULong* ipScore /*OUT*/) {
-	char    c;
-	char    cArg[2];
-	Byte    iStroke[2];
-	Long    iDiff, iVal[2];
-	UInt    idx = 0;
-	Boolean bMust = false;
-  
-	MemoWrite(" F(");
+/* ----- StrokeScorerBlockSumsC ----------------------------------------------*/
+/* Plain C StrokeScorerBlockSums. */
 
-	cArg[0] = cArg[1] = 0;
-	iStroke[0] = iStroke[1] = 0;
-
-    /* Simple parser for Filter strings. assumes a1-b1 structure,
-	 * where a and b can be any single alphabetic cmd char, the 
-	 * numbers can be multiple digit, and b1 can optionally be 
-	 * followed by '!' to insist on the filter passing.  There can
-	 * be multiple filters but they have to be separated by '!' or
-	 * space(s).  The filter string is terminated by a null byte
-	 * or an 8-bit char, the beginning of the next entry.  
-	 * Leading spaces and trailing spaces are ignored. -rwells, 970722.
-	 */
+static ULong StrokeScorerBlockSumsC(StrokeScorer *pScorer, UInt iFirst,
+									UInt iCnt, ULong* piReject,
+									ULong* piSum /*OUT*/) {
+	StrokeDic* pDic = pScorer->m_pDic;
+	UInt       iPathCnt = pDic->m_pPaths->m_iCount;
+	Word*      pCol;
+	ULong*     piSquared;
+	ULong      iThisScore, iMask;
+	UInt       iStroke, i, iLive;
 
-	for (c = *cp; true; cp++, c = *cp) {
-		switch (c) {
-
-		case 'x': 
-		case 'y':
-		case 'i':
-		case 'j':
-		case 'a':
-		case 'b':
-		case 'l':
-			cArg[idx] = c;
-
-			MemoWrite2d(" c",idx);
-			MemoWrite("=");
-			MemoWriteLen(cArg+idx, 1);
-			break;
+	for (i = 0; i < iCnt; i++)
+		piSum[i] = 0;
 
-		case '0':
-		case '1':
-		case '2':
-		case '3':
-		case '4':
-		case '5':
-		case '6':
-		case '7':
-		case '8':
-		case '9':
-			iStroke[idx] = iStroke[idx] * 10 + (c - '0');
-			MemoWrite2d(":", iStroke[idx]);
-			break;
+	for (iStroke = 0; iStroke < pScorer->m_iStrokeCnt; iStroke++) {
+		pCol = pDic->m_pColPathIds + iStroke*pDic->m_iEntryCnt + iFirst;
+		piSquared = pScorer->m_piSquared + iStroke*iPathCnt;
+
+		for (i = 0, iLive = 0; i < iCnt; i++) {
+			if (piSum[i] >= piReject[i])
+				continue;
+
+			iThisScore = piSquared[pCol[i]];
+			if (iThisScore == diUnscored)
+				iThisScore = StrokeScorerSquaredCost(pScorer, iStroke, pCol[i]);
+
+			if (piSum[i] >= (diMaxScoreSquared - iThisScore))
+				piSum[i] = diMaxScoreSquared;
+			else
+				piSum[i] += iThisScore;
+			iLive++;
+		}
 
-		case '-':				/* Switch to second arg when we see minus. */
-			idx = 1;
-			MemoWrite(" - ");
+		if (iLive == 0)
 			break;
+	}
 
-		case '!':
-			bMust = true;
-			MemoWrite(" ! ");
-			/* FALLTHRU */
-
-		case ' ':
-		default:
-			MemoWrite2d(" @", idx);
-			MemoWrite(")");
-
-			/* If we are in the second argument, execute and reset. */
-			if (idx == 1) {
-				iVal[0] = StrokeScorerExtraEval(pScorer, cArg[0], iStroke[0]);
-				iVal[1] = StrokeScorerExtraEval(pScorer, cArg[1], iStroke[1]);
-				iDiff = (iVal[0] - iVal[1]);
-
-				MemoWrite(" ");
-				MemoWriteLen(cArg+0, 1);
-				MemoWrite2d("", iStroke[0]);
-				MemoWrite2d(":", iVal[0]);
-				
-				MemoWrite("-");
-				MemoWriteLen(cArg+1, 1);
-				MemoWrite2d("", iStroke[1]);
-				MemoWrite2d(":", iVal[1]);
-				
-				MemoWrite2d("=", iDiff);
-
-				if (iDiff < 0) {
-					iDiff = -iDiff;
-					if (bMust)
-						iDiff = 9999999;
-					if (*ipScore < (diMaxScoreSquared-iDiff))
-						*ipScore += iDiff;
-					else
-						*ipScore = diMaxScoreSquared;
-				}
-				else {
-					if (*ipScore > iDiff)
-						*ipScore -= iDiff;
-					else
-						*ipScore = 0;
+	for (i = 0, iMask = 0; i < iCnt; i++)
+		if (piSum[i] < piReject[i])
+			iMask |= 1UL << i;
+	return iMask;
+}
+
+#else /* SIMD_BLOCK_SUMS */
+
+/* The vector versions keep a lane per entry.  Sums never pass
+ * 2*diMaxScoreSquared and reject sums are cut to diMaxScoreSquared+1, so
+ * lane differences fit a signed 64 bit compare, and min(sum+score,
+ * diMaxScoreSquared) is the same as the C version's limit.  An entry out
+ * of the running adds 0 rather than its score, and the padding lanes of
+ * a short block start out of it.
+ */
+
+/* ----- StrokeScorerBlockSumsSse2 -------------------------------------------*/
+/* StrokeScorerBlockSums two entries to a register.  SSE2 has no 64 bit
+ * compare, so a < b is taken from the sign of a-b.
+ */
+
+#define SSE2_LESS(a, b) \
+	_mm_shuffle_epi32(_mm_srai_epi32(_mm_sub_epi64((a), (b)), 31), \
+					  _MM_SHUFFLE(3, 3, 1, 1))
+
+static ULong StrokeScorerBlockSumsSse2(StrokeScorer *pScorer, UInt iFirst,
+									   UInt iCnt, ULong* piReject,
+									   ULong* piSum /*OUT*/) {
+	StrokeDic* pDic = pScorer->m_pDic;
+	UInt       iPathCnt = pDic->m_pPaths->m_iCount;
+	__m128i    avSum[diBlockLen/2], avReject[diBlockLen/2];
+	__m128i    vMax = _mm_set1_epi64x(diMaxScoreSquared);
+	__m128i    vLive, vScore, vNeed, vFull;
+	ULong      aiReject[diBlockLen];
+	Word       awCol[diBlockLen];
+	Word*      pCol;
+	ULong*     piSquared;
+	ULong      iMask;
+	UInt       iStroke, i, iVecCnt = (iCnt+1)/2, iLive, iNeed;
+
+	for (i = 0; i < iVecCnt*2; i++)
+		aiReject[i] = (i >= iCnt) ? 0
+			: (piReject[i] > diMaxScoreSquared) ? diMaxScoreSquared+1
+			: piReject[i];
+	for (i = 0; i < iVecCnt; i++) {
+		avSum[i] = _mm_setzero_si128();
+		avReject[i] = _mm_loadu_si128((__m128i *) (aiReject + 2*i));
+	}
+
+	for (iStroke = 0; iStroke < pScorer->m_iStrokeCnt; iStroke++) {
+		pCol = pDic->m_pColPathIds + iStroke*pDic->m_iEntryCnt + iFirst;
+		if (iCnt & 1) {
+			for (i = 0; i < iCnt; i++)
+				awCol[i] = pCol[i];
+			awCol[iCnt] = 0;
+			pCol = awCol;
+		}
+		piSquared = pScorer->m_piSquared + iStroke*iPathCnt;
+
+		for (i = 0, iLive = 0; i < iVecCnt; i++) {
+			vLive = SSE2_LESS(avSum[i], avReject[i]);
+			if (_mm_movemask_pd(_mm_castsi128_pd(vLive)) == 0)
+				continue;
+
+			vScore = _mm_set_epi64x(piSquared[pCol[2*i+1]], piSquared[pCol[2*i]]);
+			vFull = _mm_cmpeq_epi32(vScore, _mm_set1_epi32(-1));
+			vNeed = _mm_and_si128(_mm_and_si128(vFull,
+								  _mm_shuffle_epi32(vFull, _MM_SHUFFLE(2, 3, 0, 1))),
+								  vLive);
+			if ((iNeed = _mm_movemask_pd(_mm_castsi128_pd(vNeed))) != 0) {
+				if (iNeed & 1)
+					StrokeScorerSquaredCost(pScorer, iStroke, pCol[2*i]);
+				if (iNeed & 2)
+					StrokeScorerSquaredCost(pScorer, iStroke, pCol[2*i+1]);
+				vScore = _mm_set_epi64x(piSquared[pCol[2*i+1]], piSquared[pCol[2*i]]);
+			}
+
+			vScore = _mm_add_epi64(avSum[i], _mm_and_si128(vScore, vLive));
+			vFull = SSE2_LESS(vMax, vScore);
+			avSum[i] = _mm_or_si128(_mm_and_si128(vFull, vMax),
+									_mm_andnot_si128(vFull, vScore));
+			iLive |= _mm_movemask_pd(_mm_castsi128_pd(SSE2_LESS(avSum[i],
+																avReject[i])));
+		}
+
+		if (iLive == 0)
+			break;
+	}
+
+	for (i = 0, iMask = 0; i < iVecCnt; i++) {
+		iMask |= (ULong) _mm_movemask_pd(_mm_castsi128_pd(
+							SSE2_LESS(avSum[i], avReject[i]))) << 2*i;
+		_mm_storeu_si128((__m128i *) (aiReject + 2*i), avSum[i]);
+	}
+	for (i = 0; i < iCnt; i++)
+		piSum[i] = aiReject[i];
+	return iMask;
+}
+
+/* ----- StrokeScorerBlockSumsAvx2 -------------------------------------------*/
+/* StrokeScorerBlockSums four entries to a register, gathering the squared
+ * scores by path id.
+ */
+
+__attribute__((target("avx2")))
+static ULong StrokeScorerBlockSumsAvx2(StrokeScorer *pScorer, UInt iFirst,
+									   UInt iCnt, ULong* piReject,
+									   ULong* piSum /*OUT*/) {
+	StrokeDic* pDic = pScorer->m_pDic;
+	UInt       iPathCnt = pDic->m_pPaths->m_iCount;
+	__m256i    avSum[diBlockLen/4], avReject[diBlockLen/4];
+	__m256i    vMax = _mm256_set1_epi64x(diMaxScoreSquared);
+	__m256i    vUnscored = _mm256_set1_epi64x(-1);
+	__m256i    vLive, vScore, vNeed;
+	__m128i    vIds;
+	ULong      aiReject[diBlockLen];
+	Word       awCol[diBlockLen];
+	Word*      pCol;
+	ULong*     piSquared;
+	ULong      iMask;
+	UInt       iStroke, i, k, iVecCnt = (iCnt+3)/4, iLive, iNeed;
+
+	for (i = 0; i < iVecCnt*4; i++)
+		aiReject[i] = (i >= iCnt) ? 0
+			: (piReject[i] > diMaxScoreSquared) ? diMaxScoreSquared+1
+			: piReject[i];
+	for (i = 0; i < iVecCnt; i++) {
+		avSum[i] = _mm256_setzero_si256();
+		avReject[i] = _mm256_loadu_si256((__m256i *) (aiReject + 4*i));
+	}
+
+	for (iStroke = 0; iStroke < pScorer->m_iStrokeCnt; iStroke++) {
+		pCol = pDic->m_pColPathIds + iStroke*pDic->m_iEntryCnt + iFirst;
+		if (iCnt & 3) {
+			for (i = 0; i < iVecCnt*4; i++)
+				awCol[i] = (i < iCnt) ? pCol[i] : 0;
+			pCol = awCol;
+		}
+		piSquared = pScorer->m_piSquared + iStroke*iPathCnt;
+
+		for (i = 0, iLive = 0; i < iVecCnt; i++) {
+			vLive = _mm256_cmpgt_epi64(avReject[i], avSum[i]);
+			if (_mm256_testz_si256(vLive, vLive))
+				continue;
+
+			vIds = _mm_cvtepu16_epi32(_mm_loadl_epi64((__m128i *) (pCol + 4*i)));
+			vScore = _mm256_i32gather_epi64((const long long *) piSquared,
+											vIds, sizeof(ULong));
+			vNeed = _mm256_and_si256(_mm256_cmpeq_epi64(vScore, vUnscored), vLive);
+			if ((iNeed = _mm256_movemask_pd(_mm256_castsi256_pd(vNeed))) != 0) {
+				for (k = 0; k < 4; k++)
+					if (iNeed & (1 << k))
+						StrokeScorerSquaredCost(pScorer, iStroke, pCol[4*i+k]);
+				vScore = _mm256_i32gather_epi64((const long long *) piSquared,
+												vIds, sizeof(ULong));
+			}
+
+			vScore = _mm256_add_epi64(avSum[i], _mm256_and_si256(vScore, vLive));
+			avSum[i] = _mm256_blendv_epi8(vScore, vMax,
+										  _mm256_cmpgt_epi64(vScore, vMax));
+			iLive |= _mm256_movemask_pd(_mm256_castsi256_pd(
+								_mm256_cmpgt_epi64(avReject[i], avSum[i])));
+		}
+
+		if (iLive == 0)
+			break;
+	}
+
+	for (i = 0, iMask = 0; i < iVecCnt; i++) {
+		iMask |= (ULong) _mm256_movemask_pd(_mm256_castsi256_pd(
+							_mm256_cmpgt_epi64(avReject[i], avSum[i]))) << 4*i;
+		_mm256_storeu_si256((__m256i *) (aiReject + 4*i), avSum[i]);
+	}
+	for (i = 0; i < iCnt; i++)
+		piSum[i] = aiReject[i];
+	return iMask;
+}
+
+#endif /* SIMD_BLOCK_SUMS */
+
+/* ----- StrokeScorerBlockSums -----------------------------------------------*/
+/* Sum the squared stroke scores of entries iFirst to iFirst+iCnt-1 (at
+ * most diBlockLen), limited to diMaxScoreSquared as StrokeScorerEvalItem
+ * does, a stroke at a time.  An entry whose sum reaches its piReject is
+ * dropped, so its later strokes never need scoring.  Returns a mask with
+ * bit i set for each entry still below its piReject.
+ */
+
+typedef ULong (*BlockSumsFunc)(StrokeScorer *pScorer, UInt iFirst,
+							   UInt iCnt, ULong* piReject, ULong* piSum);
+
+/* Picked on first use; threads racing to do so all pick the same. */
+static BlockSumsFunc s_pBlockSums;
+
+ULong StrokeScorerBlockSums(StrokeScorer *pScorer, UInt iFirst, UInt iCnt,
+							ULong* piReject, ULong* piSum /*OUT*/) {
+	if (!s_pBlockSums) {
+#ifdef SIMD_BLOCK_SUMS
+		s_pBlockSums = __builtin_cpu_supports("avx2")
+			? StrokeScorerBlockSumsAvx2 : StrokeScorerBlockSumsSse2;
+#else
+		s_pBlockSums = StrokeScorerBlockSumsC;
+#endif
+	}
+
+	return s_pBlockSums(pScorer, iFirst, iCnt, piReject, piSum);
+}
+
+/* ----- StrokeScorerSeed ---------------------------------------------------*/
+/* Start pScorer's list with pFrom's. */
+
+void StrokeScorerSeed  (StrokeScorer *pScorer, StrokeScorer *pFrom) {
+	UInt i;
+
+	for (i = 0; i < pFrom->m_iScoreLen; i++)
+		pScorer->m_pScores[i] = pFrom->m_pScores[i];
+	pScorer->m_iScoreLen = pFrom->m_iScoreLen;
+	pScorer->m_bSeeded = true;
+}
+
+/* ----- StrokeScorerTopPicks -----------------------------------------------*/
+/* Return best diMaxListCount candidates processed so far */
+
+ListMem*      StrokeScorerTopPicks (StrokeScorer *pScorer)
+{
+	ListMem*     pListMem;
+	UInt         iTotStrLen, iListSize, iTotSize;
+	CharPtr      cpList;
+	CharPtr*     cppList;
+	ScoreItemPtr pScore, pScoreBase;
+	CharPtr      cp, cpEnd;
+
+	if (!pScorer) {
+		ErrBox("StrokeScorerTopPicks: pScorer == NULL.");
+		return NULL;
+	}
+
+	/* If no list, just return an empty list. */
+	if (pScorer->m_iScoreLen <= 0)
+		return AppEmptyList();
+
+	pScoreBase = pScorer->m_pScores;
+
+	iTotStrLen = pScorer->m_iScoreLen * (diScoreTextLen + 1);
+
+	iListSize = (pScorer->m_iScoreLen+1)*sizeof(CharPtr); /* One extra for NULL terminator */
+	iTotSize = sizeof(ListMem) + iListSize + iTotStrLen;
+
+	if (!(cpList = MemPtrNew(iTotSize))) {
+		ErrBox("ERROR: no mem in top picks");
+		return NULL;
+	}
+
+	pListMem = (ListMem *) cpList;	cpList += sizeof(ListMem);
+	cppList = (CharPtr *) cpList;	cpList += iListSize;
+	
+	pListMem->m_argc = pScorer->m_iScoreLen;
+	pListMem->m_argv = cppList;	/* Copy now before we use it in loop... */
+
+	for (pScore = pScoreBase; pScore < (pScoreBase+pScorer->m_iScoreLen); pScore++) {
+		*cppList++ = cpList;
+		cpEnd = StrokeDicSkipChar(pScore->m_cp);
+		for (cp = pScore->m_cp; cp < cpEnd; cp++) /* UTF-8 character */
+			*cpList++ = *cp;
+		*cpList++ = ' ';
+		*cpList++ = ' ';
+		*cpList++ = '#';
+		StrIToA(cpList, pScore->m_iScore); /* Null terminates */
+		cpList += StrLen(cpList) + 1; /* Skip ascii number and null. */
+	}
+	*cppList = NULL;			/* NULL terminated argv vector, for luck. */
+	return pListMem;
+}
+
+/* ----- StrokeScorerEvalItem -----------------------------------------------*/
+/* Score entry iEntry.  Returns false, leaving *ipScore unset, as soon as
+ * the sum of squared stroke scores shows the final score can't be below
+ * iWorst (diUnscored for no such limit), so that most entries need
+ * neither all their strokes scored nor a square root.
+ */
+
+Boolean StrokeScorerEvalItem(StrokeScorer *pScorer, UInt iEntry,
+							 ULong iWorst, ULong* ipScore /*OUT*/) {
+	StrokeDic*   pDic = pScorer->m_pDic;
+	Word*        pPathIds = pDic->m_pPathIds + iEntry*pDic->m_iStrokeCnt;
+	UInt    iStroke;
+	ULong   iThisScore;
+	ULong   iScore = 0;
+	ULong   iReject = diUnscored;
+
+	MemoWriteLen(pDic->m_cppEntries[iEntry], /* DEBUG: tag trace with char. */
+				 StrokeDicSkipChar(pDic->m_cppEntries[iEntry]) - pDic->m_cppEntries[iEntry]);
+
+	if (pScorer->m_iStrokeCnt != pDic->m_iStrokeCnt)
+		return StrokeScorerEvalItemAlign(pScorer, iEntry, iWorst, ipScore);
+	if (pScorer->m_pParams->m_iOrderFree)
+		return StrokeScorerEvalItemFree(pScorer, iEntry, iWorst, ipScore);
+	if (pScorer->m_pParams->m_iRotate)
+		return StrokeScorerEvalItemRot(pScorer, iEntry, iWorst, ipScore);
+
+	if (iWorst != diUnscored)
+		iReject = StrokeScorerRejectSum(pScorer, iEntry, iWorst);
+
+	/* Loop through stroke descriptions */
+	for (iStroke = 0; iStroke < pScorer->m_iStrokeCnt; iStroke++) {
+
+		iThisScore = StrokeScorerStrokeCost(pScorer, iStroke, pPathIds[iStroke]);
+		
+		MemoWrite2d(" s", iStroke+1);
+		MemoWrite2d("=", iThisScore); /* DEBUG: stroke score */
+
+		if (iThisScore >= diMaxScoreToSquare)
+			iThisScore = diMaxScoreSquared;
+		else
+			iThisScore = (iThisScore * iThisScore);
+
+		if (iScore >= (diMaxScoreSquared - iThisScore))
+			iScore = diMaxScoreSquared;
+		else
+			iScore += iThisScore;
+
+		if (iScore >= iReject) {
+			MemoWrite(" rejected\n");
+			return false;
+		}
+
+	} /* end loop through stroke descriptions */
+
+	*ipScore = StrokeScorerFinish(pScorer, iEntry, iScore, NULL);
+	return true;
+}
+
+/* ----- StrokeScorerEvalItemRot --------------------------------------------*/
+/* StrokeScorerEvalItem with the user's strokes turned each way by up to
+ * m_iRotate 32nds, all by the same amount, keeping the best turn.
+ */
+
+Boolean StrokeScorerEvalItemRot(StrokeScorer *pScorer, UInt iEntry,
+								ULong iWorst, ULong* ipScore /*OUT*/) {
+	StrokeDic*   pDic = pScorer->m_pDic;
+	Word*        pPathIds = pDic->m_pPathIds + iEntry*pDic->m_iStrokeCnt;
+	UInt    iRotCnt = 2*pScorer->m_pParams->m_iRotate + 1;
+	UInt    iStroke, iRot;
+	ULong   aiScore[2*diMaxRotate+1];
+	ULong*  piSquared;
+	ULong   iReject = diUnscored;
+	Boolean bLive;
+
+	if (iWorst != diUnscored)
+		iReject = StrokeScorerRejectSum(pScorer, iEntry, iWorst);
+
+	for (iRot = 0; iRot < iRotCnt; iRot++)
+		aiScore[iRot] = 0;
+
+	for (iStroke = 0; iStroke < pScorer->m_iStrokeCnt; iStroke++) {
+		piSquared = StrokeScorerRotSquared(pScorer, iStroke, pPathIds[iStroke]);
+		if (!piSquared)
+			return false;
+
+		/* Drop the entry once no turn can make the list. */
+		for (iRot = 0, bLive = false; iRot < iRotCnt; iRot++) {
+			if (aiScore[iRot] >= (diMaxScoreSquared - piSquared[iRot]))
+				aiScore[iRot] = diMaxScoreSquared;
+			else
+				aiScore[iRot] += piSquared[iRot];
+			if (aiScore[iRot] < iReject)
+				bLive = true;
+		}
+		if (!bLive)
+			return false;
+	}
+
+	for (iRot = 1; iRot < iRotCnt; iRot++)
+		if (aiScore[iRot] < aiScore[0])
+			aiScore[0] = aiScore[iRot];
+
+	*ipScore = StrokeScorerFinish(pScorer, iEntry, aiScore[0], NULL);
+	return true;
+}
+
+/* ----- StrokeScorerEvalItemFree -------------------------------------------*/
+/* StrokeScorerEvalItem pairing the user's strokes with the entry's in
+ * whatever order gives the least sum, for users who don't write strokes
+ * in the standard order.  The stroke scores fill a matrix a user stroke
+ * at a time; the least score in each row bounds the sum, so the entry
+ * (or turn) is dropped as soon as those reach what it must beat, before
+ * the assignment is solved.
+ */
+
+Boolean StrokeScorerEvalItemFree(StrokeScorer *pScorer, UInt iEntry,
+								 ULong iWorst, ULong* ipScore /*OUT*/) {
+	StrokeDic*   pDic = pScorer->m_pDic;
+	Word*        pPathIds = pDic->m_pPathIds + iEntry*pDic->m_iStrokeCnt;
+	UInt    iCnt = pScorer->m_iStrokeCnt;
+	UInt    iRotate = pScorer->m_pParams->m_iRotate;
+	UInt    iUser, iStroke, iRot;
+	ULong   aiCost[diMaxStrokes*diMaxStrokes];
+	Byte    abUser[diMaxStrokes], abBest[diMaxStrokes];
+	ULong*  piSquared;
+	ULong   iThisScore, iRowMin, iBound, iSum;
+	ULong   iReject = diUnscored;
+	ULong   iBest = diUnscored;
+
+	if (!iRotate && !StrokeScorerSquared(pScorer))
+		return false;
+
+	if (iWorst != diUnscored)
+		iReject = StrokeScorerRejectSumFree(pScorer, iEntry, iWorst);
+
+	for (iRot = 0; iRot < 2*iRotate + 1; iRot++) {
+		for (iUser = 0, iBound = 0; iUser < iCnt; iUser++) {
+			iRowMin = diUnscored;
+			for (iStroke = 0; iStroke < iCnt; iStroke++) {
+				if (iRotate) {
+					piSquared = StrokeScorerRotSquared(pScorer, iUser,
+													   pPathIds[iStroke]);
+					if (!piSquared)
+						return false;
+					iThisScore = piSquared[iRot];
 				}
+				else
+					iThisScore = StrokeScorerSquaredCost(pScorer, iUser,
+														 pPathIds[iStroke]);
+
+				aiCost[iUser*iCnt + iStroke] = iThisScore;
+				if (iThisScore < iRowMin)
+					iRowMin = iThisScore;
+			}
+
+			if (iBound >= (diMaxScoreSquared - iRowMin))
+				iBound = diMaxScoreSquared;
+			else
+				iBound += iRowMin;
+			if (iBound >= iReject || iBound >= iBest)
+				break;
+		}
+		if (iUser < iCnt)
+			continue;
+
+		iSum = StrokeAssign(aiCost, iCnt, abUser);
+		if (iSum < iBest) {
+			iBest = iSum;
+			memcpy(abBest, abUser, iCnt);
+		}
+	}
+
+	if (iBest == diUnscored || iBest >= iReject)
+		return false;
+
+	*ipScore = StrokeScorerFinish(pScorer, iEntry, iBest, abBest);
+	return true;
+}
 
-				MemoWrite2d(" ips=", *ipScore);
+/* ----- StrokeAssign --------------------------------------------------------*/
+/* The least sum, limited to diMaxScoreSquared, of iCnt costs from the
+ * iCnt by iCnt matrix piCost (rows are user strokes) taking one in each
+ * row and column, by the Hungarian method.  bpUser gets the row taken in
+ * each column.  The potentials are kept in double, which holds every
+ * difference of such sums exactly.
+ */
+
+#define dfHugePotential 1e300
 
-				/* Reset state for next filter... */
-				idx = 0;
-				bMust = false;
-				cArg[0] = cArg[1] = 0;
-				iStroke[0] = iStroke[1] = 0;
+static ULong StrokeAssign(ULong* piCost, UInt iCnt, Byte* bpUser /*OUT*/) {
+	double  adRow[diMaxStrokes+1], adCol[diMaxStrokes+1], adMin[diMaxStrokes+1];
+	UInt    aiMatch[diMaxStrokes+1], aiWay[diMaxStrokes+1];
+	Boolean abUsed[diMaxStrokes+1];
+	double  dDelta, dCost;
+	UInt    iRow, iCol, iCol0, iCol1, iRow0;
+	ULong   iSum, iThisScore;
+
+	/* Rows and columns count from 1 here; column 0 holds the row being
+	 * added.
+	 */
+	for (iCol = 0; iCol <= iCnt; iCol++) {
+		adRow[iCol] = adCol[iCol] = 0;
+		aiMatch[iCol] = 0;
+	}
+
+	for (iRow = 1; iRow <= iCnt; iRow++) {
+		aiMatch[0] = iRow;
+		iCol0 = 0;
+		for (iCol = 0; iCol <= iCnt; iCol++) {
+			adMin[iCol] = dfHugePotential;
+			abUsed[iCol] = false;
+		}
+
+		do {	/* Grow alternating paths until one reaches a free column. */
+			abUsed[iCol0] = true;
+			iRow0 = aiMatch[iCol0];
+			dDelta = dfHugePotential;
+			iCol1 = 0;
+			for (iCol = 1; iCol <= iCnt; iCol++) {
+				if (abUsed[iCol])
+					continue;
+				dCost = (double) piCost[(iRow0-1)*iCnt + iCol-1] -
+					adRow[iRow0] - adCol[iCol];
+				if (dCost < adMin[iCol]) {
+					adMin[iCol] = dCost;
+					aiWay[iCol] = iCol0;
+				}
+				if (adMin[iCol] < dDelta) {
+					dDelta = adMin[iCol];
+					iCol1 = iCol;
+				}
 			}
+			for (iCol = 0; iCol <= iCnt; iCol++) {
+				if (abUsed[iCol]) {
+					adRow[aiMatch[iCol]] += dDelta;
+					adCol[iCol] -= dDelta;
+				}
+				else
+					adMin[iCol] -= dDelta;
+			}
+			iCol0 = iCol1;
+		} while (aiMatch[iCol0] != 0);
+
+		do {	/* Flip the path. */
+			iCol1 = aiWay[iCol0];
+			aiMatch[iCol0] = aiMatch[iCol1];
+			iCol0 = iCol1;
+		} while (iCol0);
+	}
+
+	for (iCol = 1, iSum = 0; iCol <= iCnt; iCol++) {
+		bpUser[iCol-1] = aiMatch[iCol] - 1;
+		iThisScore = piCost[(aiMatch[iCol]-1)*iCnt + iCol-1];
+		if (iSum >= (diMaxScoreSquared - iThisScore))
+			iSum = diMaxScoreSquared;
+		else
+			iSum += iThisScore;
+	}
+	return iSum;
+}
+
+/* ----- StrokeScorerEvalItemAlign ------------------------------------------*/
+/* StrokeScorerEvalItem for an entry with a different stroke count from
+ * the user's, up to m_iStrokeEdits more or fewer.  With more user strokes,
+ * some pairs of consecutive ones were a single stroke broken in two; with
+ * fewer, some user strokes join two consecutive ones.  The alignment is
+ * found by dynamic programming over the shorter side, tracking how many
+ * edits have been made so far; each costs m_iEditCost as a stroke score.
+ * All the edits are of the one kind, so it takes a drawing with both
+ * kinds to be missed.
+ */
+
+Boolean StrokeScorerEvalItemAlign(StrokeScorer *pScorer, UInt iEntry,
+								  ULong iWorst, ULong* ipScore /*OUT*/) {
+	StrokeDic*   pDic = pScorer->m_pDic;
+	Word*        pPathIds = pDic->m_pPathIds + iEntry*pDic->m_iStrokeCnt;
+	const StrokeScorerParams* pParams = pScorer->m_pParams;
+	UInt    iUserCnt = pScorer->m_iStrokeCnt;
+	UInt    iDicCnt = pDic->m_iStrokeCnt;
+	Boolean bBroken = iUserCnt > iDicCnt;	/* Else joined */
+	UInt    iEdits = bBroken ? iUserCnt - iDicCnt : iDicCnt - iUserCnt;
+	UInt    iRows = bBroken ? iDicCnt : iUserCnt;
+	UInt    iRow, iEdit, iStroke, iPath;
+	ULong   aiSum[diMaxStrokes+1], aiNext[diMaxStrokes+1];
+	ULong   iThisScore, iMin, iSum;
+	ULong   iReject = diUnscored;
+
+	if (iEdits > pParams->m_iStrokeEdits || !StrokeScorerSquared(pScorer))
+		return false;
+
+	if (iWorst != diUnscored && iWorst <= diMaxScoreToSquare)
+		iReject = SqrtULongBound(iWorst);
+
+	/* aiSum[iEdit] is the least sum with iRow strokes of the shorter side
+	 * used and iEdit edits made, the edits' cost charged up front.
+	 */
+	iThisScore = (pParams->m_iEditCost >= diMaxScoreToSquare)
+		? diMaxScoreSquared : pParams->m_iEditCost * pParams->m_iEditCost;
+	aiSum[0] = (iThisScore >= diMaxScoreSquared / iEdits)
+		? diMaxScoreSquared : iThisScore * iEdits;
+	if (aiSum[0] >= iReject)
+		return false;
+	for (iEdit = 1; iEdit <= iEdits; iEdit++)
+		aiSum[iEdit] = diUnscored;
+
+	for (iRow = 0; iRow < iRows; iRow++) {
+		for (iEdit = 0; iEdit <= iEdits; iEdit++)
+			aiNext[iEdit] = diUnscored;
+
+		for (iEdit = 0; iEdit <= iEdits; iEdit++) {
+			if (aiSum[iEdit] == diUnscored)
+				continue;
+			iStroke = iRow + (bBroken ? iEdit : 0);
+			iPath = iRow + (bBroken ? 0 : iEdit);
+			if (iStroke >= iUserCnt || iPath >= iDicCnt)
+				continue;
+
+			/* Stroke for stroke. */
+			iThisScore = StrokeScorerSquaredCost(pScorer, iStroke,
+												 pPathIds[iPath]);
+			iSum = (aiSum[iEdit] >= diMaxScoreSquared - iThisScore)
+				? diMaxScoreSquared : aiSum[iEdit] + iThisScore;
+			if (iSum < aiNext[iEdit])
+				aiNext[iEdit] = iSum;
+
+			/* Two user strokes for one, or one for two. */
+			if (iEdit == iEdits || aiSum[iEdit] >= iReject ||
+				(bBroken ? iStroke+1 >= iUserCnt : iPath+1 >= iDicCnt))
+				continue;
+			iThisScore = StrokeScorerEditCost(pScorer, iStroke, pPathIds[iPath],
+											  bBroken ? diNoPath
+											  : pPathIds[iPath+1]);
+			iSum = (aiSum[iEdit] >= diMaxScoreSquared - iThisScore)
+				? diMaxScoreSquared : aiSum[iEdit] + iThisScore;
+			if (iSum < aiNext[iEdit+1])
+				aiNext[iEdit+1] = iSum;
+		}
+
+		for (iEdit = 0, iMin = diUnscored; iEdit <= iEdits; iEdit++) {
+			aiSum[iEdit] = aiNext[iEdit];
+			if (aiSum[iEdit] < iMin)
+				iMin = aiSum[iEdit];
+		}
+		if (iMin >= iReject) {
+			MemoWrite(" rejected\n");
+			return false;
+		}
+	}
+
+	if (aiSum[iEdits] >= iReject)
+		return false;
+
+	*ipScore = StrokeScorerFinish(pScorer, iEntry, aiSum[iEdits], NULL);
+	return true;
+}
+
+/* ----- StrokeScorerEditCost ------------------------------------------------*/
+/* The squared score, limited to diMaxScoreSquared, of user stroke iStroke
+ * against paths iPathId and iNextPathId drawn as one stroke, or if
+ * iNextPathId is diNoPath, of user strokes iStroke and iStroke+1 drawn
+ * as one against path iPathId.  Either way the pen's move between the
+ * two is part of the stroke.  Kept in a small table by the ids, where a
+ * clash just costs a rescore.
+ */
+
+#define diEditCacheLen 4096		/* Power of 2; two keys and cost each */
+
+ULong StrokeScorerEditCost(StrokeScorer *pScorer, UInt iStroke,
+						   UInt iPathId, UInt iNextPathId) {
+	StrokePaths* pPaths = pScorer->m_pDic->m_pPaths;
+	RawStroke*   rsp = &(pScorer->m_pRawStrokes[iStroke]);
+	RawStroke    rsJoined;
+	Byte         abPath[2*diPathBufLen];
+	ULong        iKey, iThisScore;
+	ULong*       piSlot;
+	UInt         i;
+
+	iKey = (ULong) (iNextPathId & 0xffff) << 16 | iPathId;
+
+	if (!pScorer->m_piEditCache) {
+		pScorer->m_piEditCache =
+			(ULong *) MemPtrNew(3*diEditCacheLen*sizeof(ULong));
+		if (pScorer->m_piEditCache) {
+			for (i = 0; i < diEditCacheLen; i++)
+				pScorer->m_piEditCache[3*i] = diUnscored;
+		}
+	}
+
+	piSlot = NULL;
+	if (pScorer->m_piEditCache) {
+		piSlot = pScorer->m_piEditCache +
+			3*((iKey ^ (iKey >> 11) ^ (iStroke * 0x9e5)) & (diEditCacheLen-1));
+		if (piSlot[0] == iKey && piSlot[1] == iStroke)
+			return piSlot[2];
+	}
+
+	if (iNextPathId == diNoPath) {
+		rsJoined.m_len = rsp[0].m_len + rsp[1].m_len;
+		if (rsJoined.m_len > diMaxXyPairs)
+			rsJoined.m_len = 0;		/* Scores diHugeCost */
+		else {
+			memcpy(rsJoined.m_x, rsp[0].m_x, rsp[0].m_len);
+			memcpy(rsJoined.m_y, rsp[0].m_y, rsp[0].m_len);
+			memcpy(rsJoined.m_x + rsp[0].m_len, rsp[1].m_x, rsp[1].m_len);
+			memcpy(rsJoined.m_y + rsp[0].m_len, rsp[1].m_y, rsp[1].m_len);
+		}
+		iThisScore = StrokeDicScoreStroke(pScorer->m_pParams,
+										  rsJoined.m_x, rsJoined.m_y, NULL,
+										  rsJoined.m_len,
+										  (CharPtr) pPaths->m_bpCodes + iPathId*diPathBufLen,
+										  pPaths->m_bpLen[iPathId],
+										  0 /*depth*/);
+	}
+	else {
+		memcpy(abPath, pPaths->m_bpCodes + iPathId*diPathBufLen,
+				pPaths->m_bpLen[iPathId]);
+		memcpy(abPath + pPaths->m_bpLen[iPathId],
+				pPaths->m_bpCodes + iNextPathId*diPathBufLen,
+				pPaths->m_bpLen[iNextPathId]);
+		iThisScore = StrokeDicScoreStroke(pScorer->m_pParams,
+										  rsp->m_x, rsp->m_y,
+										  StrokeScorerCorners(pScorer, iStroke),
+										  rsp->m_len, (CharPtr) abPath,
+										  pPaths->m_bpLen[iPathId] +
+										  pPaths->m_bpLen[iNextPathId],
+										  0 /*depth*/);
+	}
+
+	iThisScore = (iThisScore >= diMaxScoreToSquare)
+		? diMaxScoreSquared : iThisScore * iThisScore;
+	if (piSlot) {
+		piSlot[0] = iKey;
+		piSlot[1] = iStroke;
+		piSlot[2] = iThisScore;
+	}
+	return iThisScore;
+}
+
+/* ----- StrokeScorerRotSquared ----------------------------------------------*/
+/* User stroke iStroke's squared scores against path iPathId, limited to
+ * diMaxScoreSquared, turned by each of -m_iRotate to m_iRotate 32nds in
+ * turn.  Kept in m_piRotSquared; NULL if can't get memory.
+ */
+
+ULong* StrokeScorerRotSquared(StrokeScorer *pScorer, UInt iStroke,
+							  UInt iPathId) {
+	StrokePaths* pPaths = pScorer->m_pDic->m_pPaths;
+	UInt    iRotCnt = 2*pScorer->m_pParams->m_iRotate + 1;
+	UInt    iLen = pScorer->m_iStrokeCnt * pPaths->m_iCount * iRotCnt;
+	UInt    i;
+	ULong*  piSquared;
+	RawStroke* rsp;
+
+	if (!pScorer->m_piRotSquared) {
+		pScorer->m_piRotSquared = (ULong *) MemPtrNew((iLen+1)*sizeof(ULong));
+		if (!pScorer->m_piRotSquared) {
+			ErrBox("Not enough memory.");
+			return NULL;
+		}
+		for (i = 0; i < iLen; i++)
+			pScorer->m_piRotSquared[i] = diUnscored;
+	}
+
+	piSquared = pScorer->m_piRotSquared +
+		(iStroke*pPaths->m_iCount + iPathId)*iRotCnt;
+
+	if (piSquared[0] == diUnscored) {
+		rsp = &(pScorer->m_pRawStrokes[iStroke]);
+
+		StrokeDicScoreStrokeRot(pScorer->m_pParams, rsp->m_x, rsp->m_y,
+								StrokeScorerCorners(pScorer, iStroke),
+								rsp->m_len,
+								(CharPtr) pPaths->m_bpCodes + iPathId*diPathBufLen,
+								pPaths->m_bpLen[iPathId], 0 /*depth*/,
+								pScorer->m_pParams->m_iRotate, piSquared);
+
+		for (i = 0; i < iRotCnt; i++)
+			piSquared[i] = (piSquared[i] >= diMaxScoreToSquare)
+				? diMaxScoreSquared : piSquared[i] * piSquared[i];
+	}
+
+	return piSquared;
+}
+
+/* ----- StrokeScorerStrokeCost ----------------------------------------------*/
+/* User stroke iStroke's StrokeDicScoreStroke score against path iPathId,
+ * through the stroke's cache.
+ */
+
+ULong StrokeScorerStrokeCost(StrokeScorer *pScorer, UInt iStroke,
+							 UInt iPathId) {
+	StrokePaths* pPaths = pScorer->m_pDic->m_pPaths;
+	StrokeCostCache* pCache;
+	RawStroke* rsp;
+	ULong   iThisScore;
+
+	if (!(pCache = pScorer->m_apCache[iStroke])) {
+		pCache = StrokeCostCacheCreate(pPaths);
+		if (pCache) {
+			pScorer->m_apCache[iStroke] = pCache;
+			pScorer->m_iOwnCaches |= (1UL << iStroke);
+		}
+	}
+
+	if (pCache && pCache->m_piCost[iPathId] != diUnscored)
+		return pCache->m_piCost[iPathId];
+
+	rsp = &(pScorer->m_pRawStrokes[iStroke]);
+
+	iThisScore = StrokeDicScoreStroke(pScorer->m_pParams,
+									  rsp->m_x, rsp->m_y,
+									  StrokeScorerCorners(pScorer, iStroke),
+									  rsp->m_len,
+									  (CharPtr) pPaths->m_bpCodes + iPathId*diPathBufLen,
+									  pPaths->m_bpLen[iPathId],
+									  0 /*depth*/);
+	if (pCache)
+		pCache->m_piCost[iPathId] = iThisScore;
+
+	return iThisScore;
+}
+
+/* ----- StrokeScorerRejectSum -----------------------------------------------*/
+/* The sum of squared stroke scores at which entry iEntry can't score below
+ * iWorst.  Filters can take at most the sum of their positive differences
+ * off the root, so allow for those.  diUnscored if there is no such sum.
+ */
+
+ULong StrokeScorerRejectSum(StrokeScorer *pScorer, UInt iEntry, ULong iWorst) {
+	StrokeDic*    pDic = pScorer->m_pDic;
+	StrokeFilter* pFilter;
+	Long          iDiff;
+
+	for (pFilter = pDic->m_pFilters + pDic->m_piFilters[iEntry];
+		 pFilter < pDic->m_pFilters + pDic->m_piFilters[iEntry+1];
+		 pFilter++) {
+		iDiff = pScorer->m_aiFeatures[pFilter->m_iFeat[0]] -
+			pScorer->m_aiFeatures[pFilter->m_iFeat[1]];
+		if (iDiff > 0)
+			iWorst += iDiff;
+	}
 
-			/* If this is a terminating char, break out of loop and return. */
-			if ((c & 0x80) || (c == '\0'))
-				goto ReturnNow;
-		} /* end switch on char */
-	} /* end for each char in filter spec... */
-ReturnNow:
-	return cp;
+	return (iWorst <= diMaxScoreToSquare) ? SqrtULongBound(iWorst) : diUnscored;
 }
 
-/* ----- StrokeScorerExtraEval ------------------------------------------------*/
+/* ----- StrokeScorerRejectSumFree ------------------------------------------*/
+/* StrokeScorerRejectSum for any pairing of the user's strokes with the
+ * entry's: a filter takes off no more than its first feature's largest
+ * value over the strokes less its second's smallest.
+ */
+
+ULong StrokeScorerRejectSumFree(StrokeScorer *pScorer, UInt iEntry,
+								ULong iWorst) {
+	StrokeDic*    pDic = pScorer->m_pDic;
+	StrokeFilter* pFilter;
+	Long          iDiff, iHigh, iLow;
+
+	for (pFilter = pDic->m_pFilters + pDic->m_piFilters[iEntry];
+		 pFilter < pDic->m_pFilters + pDic->m_piFilters[iEntry+1];
+		 pFilter++) {
+		iHigh = (pFilter->m_iFeat[0] == diFeatNone) ? 0
+			: pScorer->m_aiFeatMax[(pFilter->m_iFeat[0]-1) % diFeatCnt];
+		iLow = (pFilter->m_iFeat[1] == diFeatNone) ? 0
+			: pScorer->m_aiFeatMin[(pFilter->m_iFeat[1]-1) % diFeatCnt];
+		iDiff = iHigh - iLow;
+		if (iDiff > 0)
+			iWorst += iDiff;
+	}
+
+	return (iWorst <= diMaxScoreToSquare) ? SqrtULongBound(iWorst) : diUnscored;
+}
+
+/* ----- StrokeScorerFinish --------------------------------------------------*/
+/* Entry iEntry's final score from its sum of squared stroke scores.
+ * bpUser, if not NULL, gives the user stroke paired with each of the
+ * entry's strokes.
+ */
+
+ULong StrokeScorerFinish(StrokeScorer *pScorer, UInt iEntry, ULong iSum,
+						 Byte* bpUser) {
+	StrokeDic* pDic = pScorer->m_pDic;
+	ULong      iScore;
+
+	iScore = SqrtULong(iSum);
+
+	MemoWrite2d(" is=", iScore); /* DEBUG: overall stroke score */
+
+    /* Handle optional extra filters... may modify iScore.  They name the
+	 * entry's strokes, which don't all have a user stroke of their own
+	 * when strokes were joined or broken, or not all written yet.
+	 */
+	if (pDic->m_piFilters[iEntry] != pDic->m_piFilters[iEntry+1] &&
+		pDic->m_iStrokeCnt == pScorer->m_iStrokeCnt && !pScorer->m_bPrefix)
+		StrokeScorerExtraFilters(pScorer, iEntry, bpUser, &iScore);
+
+	MemoWrite2d(" fs=", iScore); /* DEBUG: final score */
+	MemoWrite("\n");
+	return iScore;
+}
+
+/* ----- StrokeDicScoreStroke ---------------------------------------------- */
+
+/* Most paths are one to four directions long, so those lengths have
+ * their own scorers below, which StrokeDicScoreStroke hands off to; each
+ * works exactly as the general case would for its length.
+ */
+
+/* ----- StrokeScoreSegment ------------------------------------------------ */
+/* Score a piece of the user stroke against the single direction iPath32. */
+
+static ULong StrokeScoreSegment(const StrokeScorerParams* pParams,
+								Byte* bpX, Byte* bpY, UInt iLen,
+								UInt iPath32, UInt iDepth) {
+	ULong iScore;
+	Long iMid;
+	Long iDifX, iDifY;
+
+	if (iLen < 2)
+		return diHugeCost(pParams);
+
+	iDifX = bpX[iLen-1] - bpX[0];
+	iDifY = bpY[0] - bpY[iLen-1]; /* Flip from display to math axes. */
+
+	if (iDifX == 0 && iDifY == 0) /* Two samples at same place... */
+		return diHugeCost(pParams);
+
+	/* Subdivide recursively while stroke is long and depth is shallow.
+	 * $$$ These values are pretty magic... review later. -rwells, 970719.
+	 * They are now in pParams, and kptune can fit them to a corpus.
+	 */
+	if ((ULong) (iDifX*iDifX + iDifY*iDifY) >
+			pParams->m_iSplitDist * pParams->m_iSplitDist &&
+		iLen > pParams->m_iSplitLen && iDepth < pParams->m_iSplitDepth) {
+
+		iMid = iLen >> 1;
+
+		/* Note that we use the middle point on both sides... */
+
+		iScore  = StrokeScoreSegment(pParams, bpX, bpY, iMid+1,
+									 iPath32, iDepth+1);
+
+		iScore += StrokeScoreSegment(pParams, bpX+iMid, bpY+iMid, iLen-iMid,
+									 iPath32, iDepth+1);
+
+		return (iScore >> 1);
+
+	} /* End if stroke is long, and depth is shallow... */
+
+	/* Time to score this segment against desired direction. */
+	
+	return pParams->m_aiAngCost[Angle32(iDifX, iDifY)][iPath32];
+}
+
+/* ----- StrokeSplitStep --------------------------------------------------- */
+/* The step between the points tried when splitting a stroke of iLen
+ * points for a path of iPathMid+iPathRest directions.  Near corners, try
+ * every point; if there are none in range, fall back on stepping.
+ * *bppSplit is set to the corner flags to use, or NULL.
+ */
+
+static Long StrokeSplitStep(const StrokeScorerParams* pParams,
+							Byte* bpCorner, UInt iLen, Long iPathMid,
+							Long iPathRest, Byte** bppSplit /*OUT*/) {
+	Long iMid;
+
+	*bppSplit = NULL;
+	if (bpCorner) {
+		for (iMid = iPathMid; iMid < iLen - iPathRest && !bpCorner[iMid]; iMid++)
+			;
+		if (iMid < iLen - iPathRest) {
+			*bppSplit = bpCorner;
+			return 1;
+		}
+	}
+
+	if (iLen < pParams->m_iStepLen || iLen < pParams->m_iStepDiv)
+		return 1;
+	return iLen / pParams->m_iStepDiv;
+}
+
+/* ----- StrokeScorePath2 -------------------------------------------------- */
+
+static ULong StrokeScorePath2(const StrokeScorerParams* pParams,
+							  Byte* bpX, Byte* bpY, Byte* bpCorner,
+							  UInt iLen, CharPtr cpPath, UInt iDepth) {
+	ULong iScore, iThisScore;
+	Long iMid, iStep;
+	Byte* bpSplit;
+
+	if (iLen < 2)
+		return diHugeCost(pParams);
+
+	iScore = diHugeCost(pParams) * 2 * 2;
+	iStep = StrokeSplitStep(pParams, bpCorner, iLen, 1, 1, &bpSplit);
+
+	for (iMid = 1; iMid < iLen - 1; iMid += iStep) {
+
+		if (bpSplit && !bpSplit[iMid])
+			continue;
+
+		iThisScore  = StrokeScoreSegment(pParams, bpX, bpY, iMid+1,
+										 cpPath[0], iDepth+1);
+
+		iThisScore += StrokeScoreSegment(pParams, bpX+iMid, bpY+iMid,
+										 iLen-iMid, cpPath[1], iDepth+1);
+
+		iThisScore >>= 1;
+
+		if (iThisScore < iScore)
+			iScore = iThisScore;
+	}
+
+	return iScore;
+}
+
+/* ----- StrokeScorePath3 -------------------------------------------------- */
+
+static ULong StrokeScorePath3(const StrokeScorerParams* pParams,
+							  Byte* bpX, Byte* bpY, Byte* bpCorner,
+							  UInt iLen, CharPtr cpPath, UInt iDepth) {
+	ULong iScore, iThisScore;
+	Long iMid, iStep;
+	Byte* bpSplit;
+
+	if (iLen < 2)
+		return diHugeCost(pParams);
+
+	iScore = diHugeCost(pParams) * 3 * 2;
+	iStep = StrokeSplitStep(pParams, bpCorner, iLen, 1, 2, &bpSplit);
+
+	for (iMid = 1; iMid < iLen - 2; iMid += iStep) {
+
+		if (bpSplit && !bpSplit[iMid])
+			continue;
+
+		iThisScore  = StrokeScoreSegment(pParams, bpX, bpY, iMid+1,
+										 cpPath[0], iDepth+1);
+
+		iThisScore += StrokeScorePath2(pParams, bpX+iMid, bpY+iMid,
+									   bpCorner ? bpCorner+iMid : NULL,
+									   iLen-iMid, cpPath+1, iDepth+1);
+
+		iThisScore >>= 1;
+
+		if (iThisScore < iScore)
+			iScore = iThisScore;
+	}
+
+	return iScore;
+}
+
+/* ----- StrokeScorePath4 -------------------------------------------------- */
+
+static ULong StrokeScorePath4(const StrokeScorerParams* pParams,
+							  Byte* bpX, Byte* bpY, Byte* bpCorner,
+							  UInt iLen, CharPtr cpPath, UInt iDepth) {
+	ULong iScore, iThisScore;
+	Long iMid, iStep;
+	Byte* bpSplit;
+
+	if (iLen < 2)
+		return diHugeCost(pParams);
+
+	iScore = diHugeCost(pParams) * 4 * 2;
+	iStep = StrokeSplitStep(pParams, bpCorner, iLen, 2, 2, &bpSplit);
 
-Long StrokeScorerExtraEval(StrokeScorer *pScorer,
-						   char cArg, UInt iStroke) {
+	for (iMid = 2; iMid < iLen - 2; iMid += iStep) {
+
+		if (bpSplit && !bpSplit[iMid])
+			continue;
+
+		iThisScore  = StrokeScorePath2(pParams, bpX, bpY, bpCorner,
+									   iMid+1, cpPath, iDepth+1);
+
+		iThisScore += StrokeScorePath2(pParams, bpX+iMid, bpY+iMid,
+									   bpCorner ? bpCorner+iMid : NULL,
+									   iLen-iMid, cpPath+2, iDepth+1);
+
+		iThisScore >>= 1;
+
+		if (iThisScore < iScore)
+			iScore = iThisScore;
+	}
+
+	return iScore;
+}
+
+/* ----- StrokeDicScoreStroke ---------------------------------------------- */
+
+/* bpCorner, if not NULL, flags the points a multi-direction path may be
+ * split at (see StrokeScorerCorners).
+ */
+
+ULong StrokeDicScoreStroke(const StrokeScorerParams* pParams,
+						   Byte* bpX, Byte* bpY, Byte* bpCorner,
+						   UInt iLen, CharPtr cpPath, UInt iPathLen,
+						   UInt iDepth) {
+	ULong iScore, iThisScore;
+	Long iMid, iStep, iPathMid, iPathRest;
+	Byte* bpSplit;
+
+	if (iLen < 2 || iPathLen < 1)
+		return diHugeCost(pParams);
+
+	switch (iPathLen) {
+	case 1:
+		return StrokeScoreSegment(pParams, bpX, bpY, iLen, *cpPath, iDepth);
+	case 2:
+		return StrokeScorePath2(pParams, bpX, bpY, bpCorner, iLen, cpPath,
+								iDepth);
+	case 3:
+		return StrokeScorePath3(pParams, bpX, bpY, bpCorner, iLen, cpPath,
+								iDepth);
+	case 4:
+		return StrokeScorePath4(pParams, bpX, bpY, bpCorner, iLen, cpPath,
+								iDepth);
+	}
+
+	iScore = diHugeCost(pParams) * iPathLen * 2;
+	iPathMid = iPathLen >> 1;
+	iPathRest = iPathLen - iPathMid;
+	iStep = StrokeSplitStep(pParams, bpCorner, iLen, iPathMid, iPathRest,
+							&bpSplit);
+
+	for (iMid = iPathMid; iMid < iLen - iPathRest; iMid += iStep) {
+
+		if (bpSplit && !bpSplit[iMid])
+			continue;
+
+		/* TDR original doesn't increase iDepth... -rwells, 970719. */
+
+		iThisScore  = StrokeDicScoreStroke(pParams, bpX, bpY, bpCorner,
+										   iMid+1, cpPath, iPathMid,
+										   iDepth+1);
+
+		iThisScore += StrokeDicScoreStroke(pParams, bpX+iMid, bpY+iMid,
+										   bpCorner ? bpCorner+iMid : NULL,
+										   iLen-iMid, cpPath+iPathMid,
+										   iPathRest, iDepth+1);
+
+		/* TDR original doesn't divide sum by 2... -rwells, 970719. */
+		iThisScore >>= 1;
+
+		if (iThisScore < iScore)
+			iScore = iThisScore;
+
+	} /* end for trials on various mid-point divisions of stroke... */
+
+	return iScore;
+}
+
+/* ----- StrokeDicScoreStrokeRot ------------------------------------------- */
+/* StrokeDicScoreStroke with the user stroke turned by each of -iRotate to
+ * iRotate 32nds, into piScore[0] to piScore[2*iRotate].  The turns share
+ * the work of splitting the stroke and finding segment angles; each just
+ * offsets the angle's row in m_aiAngCost.
+ */
+
+static void StrokeDicScoreStrokeRot(const StrokeScorerParams* pParams,
+									Byte* bpX, Byte* bpY, Byte* bpCorner,
+									UInt iLen, CharPtr cpPath, UInt iPathLen,
+									UInt iDepth, UInt iRotate,
+									ULong* piScore /*OUT*/) {
+	ULong aiLeft[2*diMaxRotate+1], aiRight[2*diMaxRotate+1];
+	UInt  iRotCnt = 2*iRotate + 1;
+	UInt  iRot, iAng32;
+	Long  iMid, iStep, iPathMid, iPathRest;
+	Long  iDifX, iDifY;
+	Byte* bpSplit;
+
+	for (iRot = 0; iRot < iRotCnt; iRot++)
+		piScore[iRot] = diHugeCost(pParams);
+
+	if (iLen < 2 || iPathLen < 1)
+		return;
+
+	if (iPathLen == 1) {
+		iDifX = bpX[iLen-1] - bpX[0];
+		iDifY = bpY[0] - bpY[iLen-1]; /* Flip from display to math axes. */
+
+		if (iDifX == 0 && iDifY == 0) /* Two samples at same place... */
+			return;
+
+		/* Subdivide as StrokeScoreSegment does. */
+		if ((ULong) (iDifX*iDifX + iDifY*iDifY) >
+				pParams->m_iSplitDist * pParams->m_iSplitDist &&
+			iLen > pParams->m_iSplitLen && iDepth < pParams->m_iSplitDepth) {
+
+			iMid = iLen >> 1;
+
+			StrokeDicScoreStrokeRot(pParams, bpX, bpY, NULL, iMid+1,
+									cpPath, 1, iDepth+1, iRotate, aiLeft);
+			StrokeDicScoreStrokeRot(pParams, bpX+iMid, bpY+iMid, NULL,
+									iLen-iMid, cpPath, 1, iDepth+1, iRotate,
+									aiRight);
+
+			for (iRot = 0; iRot < iRotCnt; iRot++)
+				piScore[iRot] = (aiLeft[iRot] + aiRight[iRot]) >> 1;
+			return;
+		}
+
+		iAng32 = Angle32(iDifX, iDifY) + diAngCodes - iRotate;
+		for (iRot = 0; iRot < iRotCnt; iRot++)
+			piScore[iRot] = pParams->m_aiAngCost[(iAng32 + iRot) % diAngCodes][(Byte) *cpPath];
+		return;
+	}
+
+	for (iRot = 0; iRot < iRotCnt; iRot++)
+		piScore[iRot] = diHugeCost(pParams) * iPathLen * 2;
+	iPathMid = iPathLen >> 1;
+	iPathRest = iPathLen - iPathMid;
+	iStep = StrokeSplitStep(pParams, bpCorner, iLen, iPathMid, iPathRest,
+							&bpSplit);
+
+	for (iMid = iPathMid; iMid < iLen - iPathRest; iMid += iStep) {
+
+		if (bpSplit && !bpSplit[iMid])
+			continue;
+
+		StrokeDicScoreStrokeRot(pParams, bpX, bpY, bpCorner, iMid+1,
+								cpPath, iPathMid, iDepth+1, iRotate, aiLeft);
+		StrokeDicScoreStrokeRot(pParams, bpX+iMid, bpY+iMid,
+								bpCorner ? bpCorner+iMid : NULL,
+								iLen-iMid, cpPath+iPathMid, iPathRest,
+								iDepth+1, iRotate, aiRight);
+
+		for (iRot = 0; iRot < iRotCnt; iRot++)
+			if (((aiLeft[iRot] + aiRight[iRot]) >> 1) < piScore[iRot])
+				piScore[iRot] = (aiLeft[iRot] + aiRight[iRot]) >> 1;
+	}
+}
+
+/* ----- StrokeScorerCorners -------------------------------------------------*/
+/* Flag the points of user stroke iStroke where a multi-direction path
+ * may be split: within m_iCornerSpan points of a corner, taken to be a
+ * point where the direction turns by at least m_iCornerTurn 32nds and
+ * by no less than at its neighbours.  Directions are measured to the
+ * nearest points diCornerReach away, so jitter doesn't count as turning;
+ * points with no such point on one side, near the ends, are never
+ * corners.  Worked out for the first entry that needs it and shared by
+ * the rest.  Returns NULL if corners aren't used.
+ */
+
+#define diCornerReach 6
+
+Byte* StrokeScorerCorners(StrokeScorer *pScorer, UInt iStroke) {
+	const StrokeScorerParams* pParams = pScorer->m_pParams;
+	RawStroke* rsp = pScorer->m_pRawStrokes + iStroke;
+	Byte*  bpCorner = pScorer->m_abCorners[iStroke];
+	Byte   bTurn[diMaxXyPairs];
+	Long   iLen = rsp->m_len;
+	Long   i, iPrev, iNext, iFrom, iTo, iDifX, iDifY;
+	UInt   iAngIn, iAngOut;
+
+	if (pParams->m_iCornerSpan == 0)
+		return NULL;
+	if (pScorer->m_iCornersDone & (1UL << iStroke))
+		return bpCorner;
+
+	for (i = 0; i < iLen; i++) {
+		bTurn[i] = 0;
+		bpCorner[i] = false;
+
+		for (iPrev = i-1; iPrev >= 0; iPrev--) {
+			iDifX = rsp->m_x[i] - rsp->m_x[iPrev];
+			iDifY = rsp->m_y[i] - rsp->m_y[iPrev];
+			if (iDifX*iDifX + iDifY*iDifY >= diCornerReach*diCornerReach)
+				break;
+		}
+		for (iNext = i+1; iNext < iLen; iNext++) {
+			iDifX = rsp->m_x[iNext] - rsp->m_x[i];
+			iDifY = rsp->m_y[iNext] - rsp->m_y[i];
+			if (iDifX*iDifX + iDifY*iDifY >= diCornerReach*diCornerReach)
+				break;
+		}
+		if (iPrev < 0 || iNext >= iLen)
+			continue;			/* Within reach of an end. */
+
+		iAngIn = Angle32(rsp->m_x[i] - rsp->m_x[iPrev],
+						 rsp->m_y[iPrev] - rsp->m_y[i]);
+		iAngOut = Angle32(rsp->m_x[iNext] - rsp->m_x[i],
+						  rsp->m_y[i] - rsp->m_y[iNext]);
+		if (iAngIn == 32 || iAngOut == 32)
+			continue;			/* Not moving. */
+
+		bTurn[i] = (iAngOut - iAngIn) & 31;
+		if (bTurn[i] > 16)
+			bTurn[i] = 32 - bTurn[i];
+	}
+
+	for (i = 1; i < iLen-1; i++) {
+		if (bTurn[i] < pParams->m_iCornerTurn ||
+			bTurn[i] < bTurn[i-1] || bTurn[i] < bTurn[i+1])
+			continue;
+
+		iFrom = i - (Long) pParams->m_iCornerSpan;
+		iTo = i + (Long) pParams->m_iCornerSpan;
+		if (iFrom < 0)
+			iFrom = 0;
+		if (iTo > iLen-1)
+			iTo = iLen-1;
+		for (; iFrom <= iTo; iFrom++)
+			bpCorner[iFrom] = true;
+	}
+
+	pScorer->m_iCornersDone |= (1UL << iStroke);
+	return bpCorner;
+}
+
+/* ----- StrokeScorerFeatures -----------------------------------------------*/
+/* Fill in the per stroke values the extra filters compare, once per
+ * query rather than once per entry that has a filter.
+ */
+
+void StrokeScorerFeatures(StrokeScorer *pScorer) {
+	Long* piFeat;
 	Long  iVal, iSquared;
 	Byte* bpX;
 	Byte* bpY;
-	UInt  iLen;
+	UInt  iLen, iStroke;
 	RawStroke* rsp;
 
-	iStroke--;					/* Formula strokes are 1-based, my stroke
-								 * array is 0-based. */
+	pScorer->m_aiFeatures[diFeatNone] = 0;
+	for (iStroke = 0; iStroke < diFeatCnt; iStroke++) {
+		pScorer->m_aiFeatMax[iStroke] = 0;
+		pScorer->m_aiFeatMin[iStroke] = 0;
+	}
 
-	if (iStroke >= pScorer->m_iStrokeCnt)
-		return 0;				/* Should not happen... */
-
-
-	rsp = pScorer->m_pRawStrokes + iStroke;
-	iLen = rsp->m_len;
-	bpX = rsp->m_x;
-	bpY = rsp->m_y;
-
-	/* Heretofore we have left the coordinates as we got them, screen
-	 * coordinates with 0,0 in upper left, y increasing downward,
-	 * x increasing to the right.  And the extra filters agree with this.
-	 * -rwells, 970723.
-	 *
-	 * Removed the subtraction of Rect_x, Rect_y here - it will mess
-	 * up debugging messages if the client doesn't subtract them before-
-	 * hand, but otherwise should be harmless.
-	 *  - OWT, 970903
-	 */
+	for (iStroke = 0; iStroke < pScorer->m_iStrokeCnt; iStroke++) {
+		rsp = pScorer->m_pRawStrokes + iStroke;
+		iLen = rsp->m_len;
+		bpX = rsp->m_x;
+		bpY = rsp->m_y;
+		piFeat = pScorer->m_aiFeatures + diFeatIndex(iStroke, 0);
+
+		if (iLen == 0) {		/* Nothing to measure. */
+			memset(piFeat, 0, diFeatCnt*sizeof(Long));
+			continue;
+		}
+
+		/* Heretofore we have left the coordinates as we got them, screen
+		 * coordinates with 0,0 in upper left, y increasing downward,
+		 * x increasing to the right.  And the extra filters agree with this.
+		 * -rwells, 970723.
+		 *
+		 * Removed the subtraction of Rect_x, Rect_y here - it will mess
+		 * up debugging messages if the client doesn't subtract them before-
+		 * hand, but otherwise should be harmless.
+		 *  - OWT, 970903
+		 */
+
+		piFeat[diFeatX] = bpX[0];
+		piFeat[diFeatY] = bpY[0];
+		piFeat[diFeatI] = bpX[iLen-1];
+		piFeat[diFeatJ] = bpY[iLen-1];
+		piFeat[diFeatA] = ((bpX[0] + bpX[iLen-1]) >> 1);
+		piFeat[diFeatB] = ((bpY[0] + bpY[iLen-1]) >> 1);
 
-	switch(cArg) {
-	case 'x':
-		return bpX[0];
-	case 'y':
-		return bpY[0];
-	case 'i':
-		return bpX[iLen-1];
-	case 'j':
-		return bpY[iLen-1];
-	case 'a':
-		return ((bpX[0] + bpX[iLen-1]) >> 1);
-	case 'b':
-		return ((bpY[0] + bpY[iLen-1]) >> 1);
-	
-	case 'l':
 		/* These are byte values - they can't get very large,
 		 * so don't need to check against diMaxScoreToSquare...
 		 */
@@ -672,9 +2260,67 @@ Long StrokeScorerExtraEval(StrokeScorer *pScorer,
 		iSquared = (((Long) bpY[0]) - ((Long)bpY[iLen-1]));
 		iVal += iSquared * iSquared;
 
-		return (Long) SqrtULong((Long) iVal);
+		piFeat[diFeatL] = (Long) SqrtULong((Long) iVal);
 	}
-	
-	return 0;					/* Unrecognized cArg cmd char. */
+
+	for (iStroke = 0; iStroke < pScorer->m_iStrokeCnt; iStroke++) {
+		piFeat = pScorer->m_aiFeatures + diFeatIndex(iStroke, 0);
+		for (iLen = 0; iLen < diFeatCnt; iLen++) {
+			if (iStroke == 0 || piFeat[iLen] > pScorer->m_aiFeatMax[iLen])
+				pScorer->m_aiFeatMax[iLen] = piFeat[iLen];
+			if (iStroke == 0 || piFeat[iLen] < pScorer->m_aiFeatMin[iLen])
+				pScorer->m_aiFeatMin[iLen] = piFeat[iLen];
+		}
+	}
+}
+
+/* ----- StrokeScorerExtraFilters ---------------------------------------------*/
+/* Apply entry iEntry's compiled filters (see StrokeDicCompileFilters),
+ * to the user strokes bpUser pairs with the entry's, if not NULL.
+ */
+
+#define diFeatPaired(bpUser, iFeat) \
+	(((bpUser) && (iFeat) != diFeatNone) \
+	 ? diFeatIndex((bpUser)[((iFeat)-1) / diFeatCnt], ((iFeat)-1) % diFeatCnt) \
+	 : (iFeat))
+
+void StrokeScorerExtraFilters(StrokeScorer *pScorer, UInt iEntry,
+							  Byte* bpUser, ULong* ipScore /*OUT*/) {
+	StrokeDic*    pDic = pScorer->m_pDic;
+	StrokeFilter* pFilter = pDic->m_pFilters + pDic->m_piFilters[iEntry];
+	StrokeFilter* pEnd = pDic->m_pFilters + pDic->m_piFilters[iEntry+1];
+	Long*         piFeat = pScorer->m_aiFeatures;
+	Long          iDiff;
+
+	MemoWrite(" F(");
+
+	for (; pFilter < pEnd; pFilter++) {
+		iDiff = piFeat[diFeatPaired(bpUser, pFilter->m_iFeat[0])] -
+			piFeat[diFeatPaired(bpUser, pFilter->m_iFeat[1])];
+
+		MemoWrite2d(" f", pFilter->m_iFeat[0]);
+		MemoWrite2d("-f", pFilter->m_iFeat[1]);
+		MemoWrite2d("=", iDiff);
+
+		if (iDiff < 0) {
+			iDiff = -iDiff;
+			if (pFilter->m_bMust)
+				iDiff = 9999999;
+			if (*ipScore < (diMaxScoreSquared-iDiff))
+				*ipScore += iDiff;
+			else
+				*ipScore = diMaxScoreSquared;
+		}
+		else {
+			if (*ipScore > iDiff)
+				*ipScore -= iDiff;
+			else
+				*ipScore = 0;
+		}
+
+		MemoWrite2d(" ips=", *ipScore);
+	}
+
+	MemoWrite(")");
 }
 /* ----- end of scoring.c --------------------------------------------------*/
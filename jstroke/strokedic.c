@@ -0,0 +1,624 @@
+/* -*- mode: C; c-file-style: "bsd"; tab-width: 4 -*- */
+/* strokedic.c - Load-time indexing of the stroke dictionary
+ * JStroke 1.x - Japanese Kanji handwriting recognition technology demo.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (gpl.html); if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ * Commentary:
+ *
+ * The packed dictionary string is decoded once here instead of on every
+ * lookup.  Every stroke description is reduced to an id in a table of
+ * distinct paths shared by all stroke counts; there are only a few
+ * hundred of those, so a user stroke's score against a path can be kept
+ * in a StrokeCostCache and reused by every entry that has that path.
+ * -------------------------------------------------------------------------*/
+
+#include "jstroke.h"
+
+#define diPathHashInit     512	/* Initial hash slots, power of two. */
+#define diPathAllocInit    256
+
+/* ----- StrokeDicSkipChar -------------------------------------------------*/
+/* Return the position after the character that starts the entry at cp.
+ * Entry characters are UTF-8, so every byte of one has the high order
+ * bit set and only the first is not a 10xxxxxx continuation byte.
+ */
+
+CharPtr StrokeDicSkipChar(CharPtr cp) {
+	cp++;
+	while ((*cp & 0xc0) == 0x80)
+		cp++;
+	return cp;
+}
+
+/* ----- StrokeDicParsePath ------------------------------------------------*/
+/* Decode the stroke description at cp into Angle32 path codes at cpPath.
+ * Returns the position after the stroke description, or NULL if cp
+ * does not start a stroke description.
+ */
+
+CharPtr StrokeDicParsePath(CharPtr cp, CharPtr cpPath, UInt* ipPathLen /*OUT*/) {
+	CharPtr cpPathEnd = cpPath;
+
+	switch (*cp) {		/* Break out on first char value... */
+	case 'A':			/* TDR='1' CLK=07:30 DEG=225 */
+		*cpPathEnd++ = 20; break;
+	case 'B':			/* TDR='2' CLK=06:00 DEG=180 */
+		*cpPathEnd++ = 16; break;
+	case 'C':			/* TDR='3' CLK=04:30 DEG=135 */
+		*cpPathEnd++ = 12; break;
+	case 'D':			/* TDR='4' CLK=09:00 DEG=270 */
+		*cpPathEnd++ = 24; break;
+	case 'F':			/* TDR='6' CLK=03:00 DEG=090 */
+		*cpPathEnd++ =  8; break;
+	case 'G':			/* TDR='7' CLK=10:30 DEG=315 */
+		*cpPathEnd++ = 28; break;
+	case 'H':			/* TDR='8' CLK=12:00 DEG=360 */
+		*cpPathEnd++ =  0; break;
+	case 'I':			/* TDR='9' CLK=01:30 DEG=045 */
+		*cpPathEnd++ =  4; break;
+	case 'J':			/* TDR='x' down   06:00 then 07:30 */
+		*cpPathEnd++ = 16; *cpPathEnd++ = 20; break;
+	case 'K':			/* TDR='y' down   06:00 then 04:30 */
+		*cpPathEnd++ = 16; *cpPathEnd++ = 12; break;
+	case 'L':			/* TDR='c' down   06:00 then 03:00 */
+		*cpPathEnd++ = 16; *cpPathEnd++ =  8; break;
+	case 'M':			/* TDR='b' across 03:00 then 06:00 */
+		*cpPathEnd++ =  8; *cpPathEnd++ = 16; break;
+	default:
+		return NULL;
+	} /* end switch on first char value */
+
+	for (cp++; ; cp++) {	/* Loop through following chars for stroke */
+		switch (*cp) {		/* Break out on char value... */
+		case 'a':			/* TDR='1' CLK=07:30 DEG=225 */
+			*cpPathEnd++ = 20; break;
+		case 'b':			/* TDR='2' CLK=06:00 DEG=180 */
+			*cpPathEnd++ = 16; break;
+		case 'c':			/* TDR='3' CLK=04:30 DEG=135 */
+			*cpPathEnd++ = 12; break;
+		case 'd':			/* TDR='4' CLK=09:00 DEG=270 */
+			*cpPathEnd++ = 24; break;
+		case 'f':			/* TDR='6' CLK=03:00 DEG=090 */
+			*cpPathEnd++ =  8; break;
+		case 'g':			/* TDR='7' CLK=10:30 DEG=315 */
+			*cpPathEnd++ = 28; break;
+		case 'h':			/* TDR='8' CLK=12:00 DEG=360 */
+			*cpPathEnd++ =  0; break;
+		case 'i':			/* TDR='9' CLK=01:30 DEG=045 */
+			*cpPathEnd++ =  4; break;
+		case 'j':			/* TDR='x' down   06:00 then 07:30 */
+			*cpPathEnd++ = 16; *cpPathEnd++ = 20; break;
+		case 'k':			/* TDR='y' down   06:00 then 04:30 */
+			*cpPathEnd++ = 16; *cpPathEnd++ = 12; break;
+		case 'l':			/* TDR='c' down   06:00 then 03:00 */
+			*cpPathEnd++ = 16; *cpPathEnd++ =  8; break;
+		case 'm':			/* TDR='b' across 03:00 then 06:00 */
+			*cpPathEnd++ =  8; *cpPathEnd++ = 16; break;
+		default:
+			*ipPathLen = cpPathEnd - cpPath;
+			return cp;
+		} /* end switch on char value */
+	} /* end loop through chars for stroke */
+}
+
+/* ----- StrokePathsCreate --------------------------------------------------*/
+/* Create an empty table of distinct paths. (Returns NULL if can't get memory) */
+
+StrokePaths *StrokePathsCreate  (void) {
+	StrokePaths *pPaths = (StrokePaths *) MemPtrNew(sizeof(StrokePaths));
+	UInt         i;
+
+	if (!pPaths) {
+		ErrBox("Not enough memory.");
+		return NULL;
+	}
+
+	pPaths->m_iCount = 0;
+	pPaths->m_iAlloc = diPathAllocInit;
+	pPaths->m_iHashSize = diPathHashInit;
+	pPaths->m_bpCodes = (Byte *) MemPtrNew(pPaths->m_iAlloc*diPathBufLen);
+	pPaths->m_bpLen = (Byte *) MemPtrNew(pPaths->m_iAlloc);
+	pPaths->m_bpNetAng = (Byte *) MemPtrNew(pPaths->m_iAlloc);
+	pPaths->m_piHash = (UInt *) MemPtrNew(pPaths->m_iHashSize*sizeof(UInt));
+
+	if (!pPaths->m_bpCodes || !pPaths->m_bpLen ||
+		!pPaths->m_bpNetAng || !pPaths->m_piHash) {
+		ErrBox("Not enough memory.");
+		StrokePathsDestroy(pPaths);
+		return NULL;
+	}
+
+	for (i = 0; i < pPaths->m_iHashSize; i++)
+		pPaths->m_piHash[i] = diNoPath;
+
+	return pPaths;
+}
+
+/* ----- StrokePathsDestroy -------------------------------------------------*/
+
+void StrokePathsDestroy  (StrokePaths *pPaths) {
+	if (pPaths) {
+		if (pPaths->m_bpCodes)
+			MemPtrFree (pPaths->m_bpCodes);
+		if (pPaths->m_bpLen)
+			MemPtrFree (pPaths->m_bpLen);
+		if (pPaths->m_bpNetAng)
+			MemPtrFree (pPaths->m_bpNetAng);
+		if (pPaths->m_piHash)
+			MemPtrFree (pPaths->m_piHash);
+		MemPtrFree (pPaths);
+	}
+}
+
+/* ----- StrokePathsHash ----------------------------------------------------*/
+
+static UInt StrokePathsHash(CharPtr cpPath, UInt iLen) {
+	UInt i, iHash = iLen;
+
+	for (i = 0; i < iLen; i++)
+		iHash = iHash * 31 + (Byte) cpPath[i];
+	return iHash;
+}
+
+/* ----- StrokePathsGrow ----------------------------------------------------*/
+/* Double the path storage, and the hash when it gets half full. */
+
+static Boolean StrokePathsGrow(StrokePaths *pPaths) {
+	Byte *bpCodes, *bpLen, *bpNetAng;
+	UInt *piHash;
+	UInt  iAlloc = pPaths->m_iAlloc * 2;
+	UInt  iHashSize = pPaths->m_iHashSize * 2;
+	UInt  i, iSlot;
+
+	bpCodes = (Byte *) MemPtrNew(iAlloc*diPathBufLen);
+	bpLen = (Byte *) MemPtrNew(iAlloc);
+	bpNetAng = (Byte *) MemPtrNew(iAlloc);
+	piHash = (UInt *) MemPtrNew(iHashSize*sizeof(UInt));
+
+	if (!bpCodes || !bpLen || !bpNetAng || !piHash) {
+		ErrBox("Not enough memory.");
+		if (bpCodes) MemPtrFree(bpCodes);
+		if (bpLen) MemPtrFree(bpLen);
+		if (bpNetAng) MemPtrFree(bpNetAng);
+		if (piHash) MemPtrFree(piHash);
+		return false;
+	}
+
+	memcpy(bpCodes, pPaths->m_bpCodes, pPaths->m_iCount*diPathBufLen);
+	memcpy(bpLen, pPaths->m_bpLen, pPaths->m_iCount);
+	memcpy(bpNetAng, pPaths->m_bpNetAng, pPaths->m_iCount);
+
+	for (i = 0; i < iHashSize; i++)
+		piHash[i] = diNoPath;
+	for (i = 0; i < pPaths->m_iCount; i++) {
+		iSlot = StrokePathsHash((CharPtr) bpCodes + i*diPathBufLen, bpLen[i]);
+		for (iSlot &= iHashSize-1; piHash[iSlot] != diNoPath;
+			 iSlot = (iSlot+1) & (iHashSize-1))
+			;
+		piHash[iSlot] = i;
+	}
+
+	MemPtrFree(pPaths->m_bpCodes);
+	MemPtrFree(pPaths->m_bpLen);
+	MemPtrFree(pPaths->m_bpNetAng);
+	MemPtrFree(pPaths->m_piHash);
+
+	pPaths->m_bpCodes = bpCodes;
+	pPaths->m_bpLen = bpLen;
+	pPaths->m_bpNetAng = bpNetAng;
+	pPaths->m_piHash = piHash;
+	pPaths->m_iAlloc = iAlloc;
+	pPaths->m_iHashSize = iHashSize;
+
+	return true;
+}
+
+/* ----- StrokePathsAdd -----------------------------------------------------*/
+/* Return the id of a path, adding it if it is new.
+ * Returns diNoPath if can't get memory or the path is too long.
+ */
+
+UInt StrokePathsAdd  (StrokePaths *pPaths, CharPtr cpPath, UInt iLen) {
+	/* Rough unit vectors (x100, math axes) for the 8 path directions. */
+	static const Long aDirX[8] = {   0,  71, 100,  71,    0, -71, -100, -71 };
+	static const Long aDirY[8] = { 100,  71,   0, -71, -100, -71,    0,  71 };
+
+	UInt  iSlot, iId, i;
+	Long  iSumX, iSumY, iAng;
+	Byte* bpCodes;
+
+	if (iLen < 1 || iLen > diPathBufLen)
+		return diNoPath;
+
+	iSlot = StrokePathsHash(cpPath, iLen) & (pPaths->m_iHashSize-1);
+	for (; (iId = pPaths->m_piHash[iSlot]) != diNoPath;
+		 iSlot = (iSlot+1) & (pPaths->m_iHashSize-1)) {
+		if (pPaths->m_bpLen[iId] == iLen &&
+			!memcmp(pPaths->m_bpCodes + iId*diPathBufLen, cpPath, iLen))
+			return iId;
+	}
+
+	if (pPaths->m_iCount >= diMaxPaths)
+		return diNoPath;
+
+	if (pPaths->m_iCount >= pPaths->m_iAlloc ||
+		pPaths->m_iCount*2 >= pPaths->m_iHashSize) {
+		if (!StrokePathsGrow(pPaths))
+			return diNoPath;
+		return StrokePathsAdd(pPaths, cpPath, iLen);
+	}
+
+	iId = pPaths->m_iCount++;
+	pPaths->m_piHash[iSlot] = iId;
+
+	bpCodes = pPaths->m_bpCodes + iId*diPathBufLen;
+	memcpy(bpCodes, cpPath, iLen);
+	pPaths->m_bpLen[iId] = iLen;
+
+	iSumX = iSumY = 0;
+	for (i = 0; i < iLen; i++) {
+		iSumX += aDirX[bpCodes[i] >> 2];
+		iSumY += aDirY[bpCodes[i] >> 2];
+	}
+	iAng = Angle32(iSumX, iSumY);
+	if (iAng == 32)				/* Path doubles back on itself. */
+		iAng = bpCodes[0];
+	pPaths->m_bpNetAng[iId] = iAng;
+
+	return iId;
+}
+
+/* ----- StrokeDicFeature --------------------------------------------------*/
+/* Feature table index for filter argument cArg of (1-based) stroke iStroke.
+ * Anything the filter can't mean is scored as 0, as it always was.
+ */
+
+static Byte StrokeDicFeature(char cArg, UInt iStroke, UInt iStrokeCnt) {
+	UInt iFeat;
+
+	if (iStroke < 1 || iStroke > iStrokeCnt)
+		return diFeatNone;
+
+	switch (cArg) {
+	case 'x': iFeat = diFeatX; break;
+	case 'y': iFeat = diFeatY; break;
+	case 'i': iFeat = diFeatI; break;
+	case 'j': iFeat = diFeatJ; break;
+	case 'a': iFeat = diFeatA; break;
+	case 'b': iFeat = diFeatB; break;
+	case 'l': iFeat = diFeatL; break;
+	default:  return diFeatNone;
+	}
+
+	return diFeatIndex(iStroke-1, iFeat);
+}
+
+/* ----- StrokeDicCompileFilters --------------------------------------------*/
+/* Compile the filter text after an entry's '|' into pFilter.
+ * Returns the count of filters written.
+ */
+
+static UInt StrokeDicCompileFilters(CharPtr cp, UInt iStrokeCnt,
+									StrokeFilter* pFilter) {
+	char    c;
+	char    cArg[2];
+	Byte    iStroke[2];
+	UInt    idx = 0;
+	UInt    iCnt = 0;
+	Boolean bMust = false;
+
+	cArg[0] = cArg[1] = 0;
+	iStroke[0] = iStroke[1] = 0;
+
+    /* Simple parser for Filter strings. assumes a1-b1 structure,
+	 * where a and b can be any single alphabetic cmd char, the 
+	 * numbers can be multiple digit, and b1 can optionally be 
+	 * followed by '!' to insist on the filter passing.  There can
+	 * be multiple filters but they have to be separated by '!' or
+	 * space(s).  The filter string is terminated by a null byte
+	 * or an 8-bit char, the beginning of the next entry.  
+	 * Leading spaces and trailing spaces are ignored. -rwells, 970722.
+	 */
+
+	for (c = *cp; true; cp++, c = *cp) {
+		switch (c) {
+
+		case 'x': 
+		case 'y':
+		case 'i':
+		case 'j':
+		case 'a':
+		case 'b':
+		case 'l':
+			cArg[idx] = c;
+			break;
+
+		case '0':
+		case '1':
+		case '2':
+		case '3':
+		case '4':
+		case '5':
+		case '6':
+		case '7':
+		case '8':
+		case '9':
+			iStroke[idx] = iStroke[idx] * 10 + (c - '0');
+			break;
+
+		case '-':				/* Switch to second arg when we see minus. */
+			idx = 1;
+			break;
+
+		case '!':
+			bMust = true;
+			/* FALLTHRU */
+
+		case ' ':
+		default:
+			/* If we are in the second argument, emit and reset. */
+			if (idx == 1) {
+				pFilter->m_iFeat[0] = StrokeDicFeature(cArg[0], iStroke[0],
+													   iStrokeCnt);
+				pFilter->m_iFeat[1] = StrokeDicFeature(cArg[1], iStroke[1],
+													   iStrokeCnt);
+				pFilter->m_bMust = bMust;
+				pFilter++;
+				iCnt++;
+
+				/* Reset state for next filter... */
+				idx = 0;
+				bMust = false;
+				cArg[0] = cArg[1] = 0;
+				iStroke[0] = iStroke[1] = 0;
+			}
+
+			/* If this is a terminating char, we're done. */
+			if ((c & 0x80) || (c == '\0'))
+				return iCnt;
+		} /* end switch on char */
+	} /* end for each char in filter spec... */
+}
+
+/* ----- StrokeDicPrefixCmp ------------------------------------------------*/
+/* Order entries by their path ids, first stroke first. */
+
+static StrokeDic *s_pPrefixDic;		/* qsort has no context pointer. */
+
+static int StrokeDicPrefixCmp(const void *pA, const void *pB) {
+	UInt  iA = *(const UInt *) pA;
+	UInt  iB = *(const UInt *) pB;
+	UInt  iStrokeCnt = s_pPrefixDic->m_iStrokeCnt;
+	Word* pIdsA = s_pPrefixDic->m_pPathIds + iA*iStrokeCnt;
+	Word* pIdsB = s_pPrefixDic->m_pPathIds + iB*iStrokeCnt;
+	UInt  iStroke;
+
+	for (iStroke = 0; iStroke < iStrokeCnt; iStroke++) {
+		if (pIdsA[iStroke] != pIdsB[iStroke])
+			return (pIdsA[iStroke] < pIdsB[iStroke]) ? -1 : 1;
+	}
+	return (iA < iB) ? -1 : (iA > iB);	/* Keep dictionary order on ties. */
+}
+
+/* ----- StrokeDicCreate ---------------------------------------------------*/
+/* Index a packed dictionary string, adding its paths to pPaths.
+ * (Returns NULL if can't get memory or the string is malformed)
+ */
+
+StrokeDic *StrokeDicCreate  (CharPtr cpStrokeDic, UInt iStrokeCnt,
+							 StrokePaths *pPaths) {
+	StrokeDic *pDic;
+	CharPtr    cp, cpNext;
+	char       path[diPathBufLen+2];
+	UInt       iEntry, iStroke, iPathLen, iId, iFilterCnt;
+	Word      *pIds, *pPrevIds;
+
+	pDic = (StrokeDic *) MemPtrNew(sizeof(StrokeDic));
+	if (!pDic) {
+		ErrBox("Not enough memory.");
+		return NULL;
+	}
+
+	pDic->m_cpStrokeDic = cpStrokeDic;
+	pDic->m_iStrokeCnt = iStrokeCnt;
+	pDic->m_pPaths = pPaths;
+	pDic->m_cppEntries = NULL;
+	pDic->m_pFilters = NULL;
+	pDic->m_piFilters = NULL;
+	pDic->m_pPathIds = NULL;
+	pDic->m_pColPathIds = NULL;
+	pDic->m_piPrefixOrder = NULL;
+	pDic->m_bpPrefixSame = NULL;
+
+	/* Entries start on a char with the high order bit set; the first
+	 * pass only counts them.  Each filter has a '-', so counting those
+	 * bounds the number of filters.
+	 */
+	pDic->m_iEntryCnt = 0;
+	iFilterCnt = 0;
+	for (cp = cpStrokeDic; *cp; ) {
+		pDic->m_iEntryCnt++;
+		cp = StrokeDicSkipChar(cp);
+		for (; *cp && !(*cp & 0x80); cp++) {
+			if (*cp == '-')
+				iFilterCnt++;
+		}
+	}
+
+	pDic->m_cppEntries = (CharPtr *) MemPtrNew((pDic->m_iEntryCnt+1)*sizeof(CharPtr));
+	pDic->m_pFilters = (StrokeFilter *) MemPtrNew((iFilterCnt+1)*sizeof(StrokeFilter));
+	pDic->m_piFilters = (UInt *) MemPtrNew((pDic->m_iEntryCnt+1)*sizeof(UInt));
+	pDic->m_pPathIds = (Word *) MemPtrNew((pDic->m_iEntryCnt*iStrokeCnt+1)*sizeof(Word));
+
+	if (!pDic->m_cppEntries || !pDic->m_pFilters || !pDic->m_piFilters ||
+		!pDic->m_pPathIds) {
+		ErrBox("Not enough memory.");
+		StrokeDicDestroy(pDic);
+		return NULL;
+	}
+
+	iFilterCnt = 0;
+	for (cp = cpStrokeDic, iEntry = 0; *cp; iEntry++) {
+		pDic->m_cppEntries[iEntry] = cp;
+		pDic->m_piFilters[iEntry] = iFilterCnt;
+
+		/* The entry's character has the high order bit set in all of
+		 * its bytes; after it, a char with high order bit set must be
+		 * the beginning of the next entry.
+		 */
+		cp = StrokeDicSkipChar(cp);
+
+		for (iStroke = 0; iStroke < iStrokeCnt; iStroke++) {
+			if (!(cpNext = StrokeDicParsePath(cp, path, &iPathLen)))
+				break;
+			cp = cpNext;
+
+			iId = StrokePathsAdd(pPaths, path, iPathLen);
+			if (iId == diNoPath)
+				break;
+			pDic->m_pPathIds[iEntry*iStrokeCnt + iStroke] = iId;
+		}
+
+		if (iStroke != iStrokeCnt) {
+			ErrBox("JStrokeDic miscount");
+			StrokeDicDestroy(pDic);
+			return NULL;
+		}
+
+		if (*cp == '|')
+			iFilterCnt += StrokeDicCompileFilters(cp+1, iStrokeCnt,
+												  pDic->m_pFilters + iFilterCnt);
+
+		while (*cp && !(*cp & 0x80))
+			cp++;
+	}
+	pDic->m_cppEntries[iEntry] = NULL;
+	pDic->m_piFilters[iEntry] = iFilterCnt;
+
+	/* Keep the path ids stroke by stroke as well. */
+	pDic->m_pColPathIds = (Word *) MemPtrNew((pDic->m_iEntryCnt*iStrokeCnt+1)*sizeof(Word));
+	if (!pDic->m_pColPathIds) {
+		ErrBox("Not enough memory.");
+		StrokeDicDestroy(pDic);
+		return NULL;
+	}
+
+	for (iStroke = 0; iStroke < iStrokeCnt; iStroke++)
+		for (iEntry = 0; iEntry < pDic->m_iEntryCnt; iEntry++)
+			pDic->m_pColPathIds[iStroke*pDic->m_iEntryCnt + iEntry] =
+				pDic->m_pPathIds[iEntry*iStrokeCnt + iStroke];
+
+	/* And the entries sorted by them, for scoring on the first few
+	 * strokes only, each run of entries starting the same way at once.
+	 */
+	pDic->m_piPrefixOrder = (UInt *) MemPtrNew((pDic->m_iEntryCnt+1)*sizeof(UInt));
+	pDic->m_bpPrefixSame = (Byte *) MemPtrNew(pDic->m_iEntryCnt+1);
+	if (!pDic->m_piPrefixOrder || !pDic->m_bpPrefixSame) {
+		ErrBox("Not enough memory.");
+		StrokeDicDestroy(pDic);
+		return NULL;
+	}
+
+	for (iEntry = 0; iEntry < pDic->m_iEntryCnt; iEntry++)
+		pDic->m_piPrefixOrder[iEntry] = iEntry;
+
+	s_pPrefixDic = pDic;
+	qsort(pDic->m_piPrefixOrder, pDic->m_iEntryCnt, sizeof(UInt),
+		  StrokeDicPrefixCmp);
+	s_pPrefixDic = NULL;
+
+	for (iEntry = 0; iEntry < pDic->m_iEntryCnt; iEntry++) {
+		iStroke = 0;
+		if (iEntry > 0) {
+			pIds = pDic->m_pPathIds + pDic->m_piPrefixOrder[iEntry]*iStrokeCnt;
+			pPrevIds = pDic->m_pPathIds + pDic->m_piPrefixOrder[iEntry-1]*iStrokeCnt;
+			while (iStroke < iStrokeCnt && pIds[iStroke] == pPrevIds[iStroke])
+				iStroke++;
+		}
+		pDic->m_bpPrefixSame[iEntry] = (Byte) iStroke;
+	}
+
+	return pDic;
+}
+
+/* ----- StrokeDicDestroy --------------------------------------------------*/
+/* Destroy a StrokeDic object (the packed string is not freed) */
+
+void StrokeDicDestroy  (StrokeDic *pDic) {
+	if (pDic) {
+		if (pDic->m_cppEntries)
+			MemPtrFree (pDic->m_cppEntries);
+		if (pDic->m_pFilters)
+			MemPtrFree (pDic->m_pFilters);
+		if (pDic->m_piFilters)
+			MemPtrFree (pDic->m_piFilters);
+		if (pDic->m_pPathIds)
+			MemPtrFree (pDic->m_pPathIds);
+		if (pDic->m_pColPathIds)
+			MemPtrFree (pDic->m_pColPathIds);
+		if (pDic->m_piPrefixOrder)
+			MemPtrFree (pDic->m_piPrefixOrder);
+		if (pDic->m_bpPrefixSame)
+			MemPtrFree (pDic->m_bpPrefixSame);
+		MemPtrFree (pDic);
+	}
+}
+
+/* ----- StrokeCostCacheCreate ----------------------------------------------*/
+/* Create an empty cache of one user stroke's scores against every path
+ * in pPaths. (Returns NULL if can't get memory)
+ */
+
+StrokeCostCache *StrokeCostCacheCreate  (StrokePaths *pPaths) {
+	StrokeCostCache *pCache;
+
+	pCache = (StrokeCostCache *) MemPtrNew(sizeof(StrokeCostCache));
+	if (!pCache) {
+		ErrBox("Not enough memory.");
+		return NULL;
+	}
+
+	pCache->m_iCount = pPaths->m_iCount;
+	pCache->m_piCost = (ULong *) MemPtrNew((pCache->m_iCount+1)*sizeof(ULong));
+	if (!pCache->m_piCost) {
+		ErrBox("Not enough memory.");
+		MemPtrFree(pCache);
+		return NULL;
+	}
+
+	StrokeCostCacheReset(pCache);
+	return pCache;
+}
+
+/* ----- StrokeCostCacheReset -----------------------------------------------*/
+/* Forget all scores, for when the user stroke changes. */
+
+void StrokeCostCacheReset  (StrokeCostCache *pCache) {
+	UInt i;
+
+	for (i = 0; i < pCache->m_iCount; i++)
+		pCache->m_piCost[i] = diUnscored;
+}
+
+/* ----- StrokeCostCacheDestroy ---------------------------------------------*/
+
+void StrokeCostCacheDestroy  (StrokeCostCache *pCache) {
+	if (pCache) {
+		MemPtrFree (pCache->m_piCost);
+		MemPtrFree (pCache);
+	}
+}
+/* ----- end of strokedic.c ------------------------------------------------*/
@@ -29,14 +29,15 @@
 #include <unistd.h>
 
 #include "kanjipad.h"
+#include "samples.h"
 
-typedef struct {
-  gchar d[2];
-} kp_wchar;
-
-#define WCHAR_EQ(a,b) (a.d[0] == b.d[0] && a.d[1] == b.d[1])
+/* A Unicode code point, as reported by the engine; 0 for none */
+typedef gunichar kp_wchar;
 #define VERSION "f-0.2"
 
+/* Saved samples, in the format of samples.h; kpsamples converts them */
+#define SAMPLES_FILE "samples.kps"
+
 /* Wait for child process? */
 
 /* user interface elements */
@@ -60,10 +61,21 @@ kp_wchar kselected;
 
 PadArea *pad_area;
 
+/* Look up automatically once the pen has rested this long (msec) */
+#define AUTO_LOOKUP_DELAY 400
+static gboolean auto_lookup;
+static guint auto_lookup_timeout;
+
+/* Have automatic lookups list the characters the strokes so far might
+ * be the start of, rather than only those with that many strokes
+ */
+static gboolean completions;
+
 /* globals for engine communication */
 static int engine_pid;
 static GIOChannel *from_engine;
 static GIOChannel *to_engine;
+static guint engine_nstrokes;	/* strokes the engine holds */
 
 static char *data_file = NULL;
 static char *progname;
@@ -72,9 +84,13 @@ static char *progname;
 static void exit_callback ();
 static void copy_callback ();
 static void save_callback ();
+static void close_samples ();
 static void clear_callback ();
+static void undo_callback ();
 static void look_up_callback ();
 static void annotate_callback ();
+static void autolookup_callback (gpointer data, guint action, GtkWidget *w);
+static void completions_callback (gpointer data, guint action, GtkWidget *w);
 static void fontselect_callback ();
 static void aboutdialog_callback ();
 static void delegateconf_callback ();
@@ -99,46 +115,114 @@ static GtkItemFactoryEntry menu_items[] =
   { "/_Character",              NULL,           NULL,               0, "<Branch>"                       },
   { "/Character/_Lookup",       "l",   look_up_callback,   0, "<StockItem>",   GTK_STOCK_FIND  },
   { "/Character/_Clear",        "x",   clear_callback,     0, "<StockItem>",   GTK_STOCK_CLEAR },
+  { "/Character/_Undo stroke",  "u",   undo_callback,      0, "<StockItem>",   GTK_STOCK_UNDO  },
   { "/Character/_Save",         "w",   save_callback,      0, "<StockItem>",   GTK_STOCK_SAVE  },
   { "/Character/_Copy",         "c",   copy_callback,      0, "<StockItem>",   GTK_STOCK_COPY  },
   { "/Character/sep1",          NULL,           NULL,               0, "<Separator>"                    },
   { "/Character/Change _font",  NULL,           fontselect_callback,0, "<StockItem>",   GTK_STOCK_SELECT_FONT },
-  { "/Character/_Annotate",     NULL,           annotate_callback,  0, "<CheckItem>"                    }
+  { "/Character/_Annotate",     NULL,           annotate_callback,  0, "<CheckItem>"                    },
+  { "/Character/Auto look_up",  NULL,           autolookup_callback,0, "<CheckItem>"                    },
+  { "/Character/Show c_ompletions", NULL,       completions_callback,0, "<CheckItem>"                   }
 };
 
 static int nmenu_items = sizeof (menu_items) / sizeof (menu_items[0]);
 
+/* Candidate glyphs are rendered once per character and state into a
+ * pixmap and then just copied into place. The cache and the character
+ * metrics are thrown away whenever karea's style (and so its font)
+ * changes.
+ */
+typedef struct {
+  GdkPixmap *pixmap;
+  gint width, height;
+} KareaGlyph;
+
+static GHashTable *karea_glyphs;
+static gint karea_char_width = -1;
+static gint karea_char_height = -1;
+
+static void
+karea_glyph_free (gpointer data)
+{
+  KareaGlyph *glyph = data;
+
+  g_object_unref (glyph->pixmap);
+  g_free (glyph);
+}
+
+static void
+karea_style_set (GtkWidget *w, GtkStyle *previous_style)
+{
+  karea_char_width = karea_char_height = -1;
+  if (karea_glyphs)
+    g_hash_table_remove_all (karea_glyphs);
+}
+
 static void
 karea_get_char_size (GtkWidget *widget,
 		     int       *width,
 		     int       *height)
 {
-  PangoLayout *layout = gtk_widget_create_pango_layout (widget, "\xe6\xb6\x88");
-  pango_layout_get_pixel_size (layout, width, height);
+  if (karea_char_height < 0)
+    {
+      PangoLayout *layout = gtk_widget_create_pango_layout (widget, "\xe6\xb6\x88");
+      pango_layout_get_pixel_size (layout, &karea_char_width, &karea_char_height);
+
+      g_object_unref (layout);
+    }
 
-  g_object_unref (layout);
+  if (width)
+    *width = karea_char_width;
+  if (height)
+    *height = karea_char_height;
 }
 
-static gchar *
-utf8_for_char (kp_wchar ch)
+/* Write ch as NUL terminated UTF-8 into buf, which holds at least 7 */
+static const gchar *
+utf8_for_char (kp_wchar ch, gchar *buf)
 {
-  gchar *string_utf;
-  GError *err = NULL;
-  gchar str[3];
+  buf[g_unichar_to_utf8 (ch, buf)] = '\0';
+
+  return buf;
+}
 
-  str[0] = ch.d[0] + 0x80;
-  str[1] = ch.d[1] + 0x80;
-  str[2] = 0;
+static KareaGlyph *
+karea_get_glyph (GtkWidget *w, kp_wchar ch, gboolean selected)
+{
+  KareaGlyph *glyph;
+  guint key = (ch << 1) | (selected != 0);
 
-  string_utf = g_convert (str, -1, "UTF-8", "EUC-JP", NULL, NULL, &err);
-  if (!string_utf)
+  if (!karea_glyphs)
+    karea_glyphs = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+					  NULL, karea_glyph_free);
+
+  glyph = g_hash_table_lookup (karea_glyphs, GUINT_TO_POINTER (key));
+  if (!glyph)
     {
-      g_printerr ("Cannot convert string from EUC-JP to UTF-8: %s\n",
-		  err->message);
-      exit (1);
+      PangoLayout *layout;
+      gchar buf[8];
+
+      layout = gtk_widget_create_pango_layout (w, utf8_for_char (ch, buf));
+
+      glyph = g_new (KareaGlyph, 1);
+      pango_layout_get_pixel_size (layout, &glyph->width, &glyph->height);
+      glyph->width = MAX (glyph->width, 1);
+      glyph->height = MAX (glyph->height, 1);
+      glyph->pixmap = gdk_pixmap_new (w->window, glyph->width, glyph->height, -1);
+
+      gdk_draw_rectangle (glyph->pixmap,
+			  selected ? w->style->bg_gc[GTK_STATE_SELECTED] :
+			  w->style->white_gc,
+			  TRUE, 0, 0, glyph->width, glyph->height);
+      gdk_draw_layout (glyph->pixmap,
+		       selected ? w->style->white_gc : w->style->black_gc,
+		       0, 0, layout);
+      g_object_unref (layout);
+
+      g_hash_table_insert (karea_glyphs, GUINT_TO_POINTER (key), glyph);
     }
 
-  return string_utf;
+  return glyph;
 }
 
 static void
@@ -146,33 +230,34 @@ karea_draw_character (GtkWidget *w,
 		      int        index,
 		      int        selected)
 {
-  PangoLayout *layout;
-  gchar *string_utf;
+  KareaGlyph *glyph;
+  GdkRectangle cell;
   gint char_width, char_height;
-  gint x;
 
   karea_get_char_size (w, &char_width, &char_height);
 
+  cell.x = 0;
+  cell.y = (char_height + 6) * index;
+  cell.width = w->allocation.width;
+  cell.height = char_height + 6;
+
   if (selected >= 0)
     {
       gdk_draw_rectangle (kpixmap,
 			  selected ? w->style->bg_gc[GTK_STATE_SELECTED] :
 			  w->style->white_gc,
 			  TRUE,
-			  0, (char_height + 6) *index, w->allocation.width - 1, char_height + 5);
+			  0, cell.y, w->allocation.width - 1, char_height + 5);
     }
 
-  string_utf = utf8_for_char (kanjiguess[index]);
-  layout = gtk_widget_create_pango_layout (w, string_utf);
-  g_free (string_utf);
+  glyph = karea_get_glyph (w, kanjiguess[index], selected > 0);
+  gdk_draw_drawable (kpixmap, w->style->fg_gc[GTK_STATE_NORMAL], glyph->pixmap,
+		     0, 0, (w->allocation.width - char_width) / 2, cell.y + 3,
+		     glyph->width, glyph->height);
 
-  x = (w->allocation.width - char_width) / 2;
-  
-  gdk_draw_layout (kpixmap, 
-		   (selected > 0) ? w->style->white_gc :
-		                    w->style->black_gc,
-		   x, (char_height + 6) * index + 3, layout);
-  g_object_unref (layout);
+  /* Only repaint this cell; karea_draw() queues the whole widget */
+  if (selected >= 0)
+    gdk_window_invalidate_rect (w->window, &cell, FALSE);
 }
 
 
@@ -190,7 +275,7 @@ karea_draw (GtkWidget *w)
 
   for (i=0; i<num_guesses; i++)
     {
-      if (WCHAR_EQ (kselected, kanjiguess[i]))
+      if (kselected == kanjiguess[i])
 	karea_draw_character (w, i, 1);
       else
 	karea_draw_character (w, i, -1);
@@ -231,11 +316,11 @@ static int
 karea_erase_selection (GtkWidget *w)
 {
   int i;
-  if (kselected.d[0] || kselected.d[1])
+  if (kselected)
     {
       for (i=0; i<num_guesses; i++)
 	{
-	  if (WCHAR_EQ (kselected, kanjiguess[i]))
+	  if (kselected == kanjiguess[i])
 	    {
 	      karea_draw_character (w, i, 0);
 	    }
@@ -251,10 +336,9 @@ karea_primary_clear (GtkClipboard *clipboard,
   GtkWidget *w = owner;
   
   karea_erase_selection (w);
-  kselected.d[0] = kselected.d[1] = 0;
+  kselected = 0;
 
   update_sensitivity ();
-  gtk_widget_queue_draw (w);
 }
 
 static void
@@ -263,11 +347,11 @@ karea_primary_get (GtkClipboard     *clipboard,
 		   guint             info,
 		   gpointer          owner)
 {
-  if (kselected.d[0] || kselected.d[1])
+  if (kselected)
     {
-      gchar *string_utf = utf8_for_char (kselected);
-      gtk_selection_data_set_text (selection_data, string_utf, -1);
-      g_free (string_utf);
+      gchar buf[8];
+
+      gtk_selection_data_set_text (selection_data, utf8_for_char (kselected, buf), -1);
     }
 }
 
@@ -301,14 +385,12 @@ karea_button_press_event (GtkWidget *w, GdkEventButton *event)
     }
   else
     {
-      kselected.d[0] = 0;
-      kselected.d[1] = 0;
+      kselected = 0;
       if (gtk_clipboard_get_owner (clipboard) == G_OBJECT (w))
 	gtk_clipboard_clear (clipboard);
     }
 
   update_sensitivity ();
-  gtk_widget_queue_draw (w);
 
   return TRUE;
 }
@@ -316,43 +398,27 @@ karea_button_press_event (GtkWidget *w, GdkEventButton *event)
 static void 
 exit_callback (GtkWidget *w)
 {
+  close_samples ();
   exit (0);
 }
 
 static void 
 copy_callback (GtkWidget *w)
 {
-  if (kselected.d[0] || kselected.d[1])
+  if (kselected)
     {
-      gchar *string_utf = utf8_for_char (kselected);
-      gtk_clipboard_set_text (gtk_clipboard_get (GDK_SELECTION_CLIPBOARD), string_utf, -1);
-      g_free (string_utf);
+      gchar buf[8];
+
+      gtk_clipboard_set_text (gtk_clipboard_get (GDK_SELECTION_CLIPBOARD),
+			      utf8_for_char (kselected, buf), -1);
     }
 }
 
-static void 
-look_up_callback (GtkWidget *w)
+static void
+send_to_engine (GString *message)
 {
-  /*	     kill 'HUP',$engine_pid; */
-  GList *tmp_list;
-  GString *message = g_string_new (NULL);
   GError *err = NULL;
-    
-  tmp_list = pad_area->strokes;
-  while (tmp_list)
-    {
-     GList *stroke_list = tmp_list->data;
-     while (stroke_list)
-       {
-	 gint16 x = ((GdkPoint *)stroke_list->data)->x;
-	 gint16 y = ((GdkPoint *)stroke_list->data)->y;
-	 g_string_append_printf (message, "%d %d ", x, y);
-	 stroke_list = stroke_list->next;
-       }
-     g_string_append (message, "\n");
-     tmp_list = tmp_list->next;
-    }
-  g_string_append (message, "\n");
+
   if (g_io_channel_write_chars (to_engine,
 				message->str, message->len,
 				NULL, &err) != G_IO_STATUS_NORMAL)
@@ -368,7 +434,78 @@ look_up_callback (GtkWidget *w)
       exit (1);
     }
 
-  g_string_free (message, FALSE);
+  g_string_free (message, TRUE);
+}
+
+/* Bring the strokes the engine holds in line with the pad. The pad only
+ * ever gains or loses a stroke at the end, so only those go over the
+ * pipe, as they are drawn, rather than every point on each lookup. The
+ * engine counts every ADD_STROKE, even one it can't look up, so
+ * engine_nstrokes stays in step with it.
+ */
+static void
+sync_engine_strokes ()
+{
+  guint nstrokes = pad_area->strokes->len;
+  guint j;
+  GString *message;
+
+  if (!to_engine)
+    return;
+
+  message = g_string_new (NULL);
+
+  if (!nstrokes && engine_nstrokes)
+    {
+      g_string_append (message, "CLEAR\n");
+      engine_nstrokes = 0;
+    }
+
+  for (; engine_nstrokes > nstrokes; engine_nstrokes--)
+    g_string_append (message, "UNDO_STROKE\n");
+
+  for (; engine_nstrokes < nstrokes; engine_nstrokes++)
+    {
+      GArray *stroke = g_ptr_array_index (pad_area->strokes, engine_nstrokes);
+
+      g_string_append (message, "ADD_STROKE");
+      for (j = 0; j < stroke->len; j++)
+	{
+	  gint16 x = g_array_index (stroke, GdkPoint, j).x;
+	  gint16 y = g_array_index (stroke, GdkPoint, j).y;
+	  g_string_append_printf (message, " %d %d", x, y);
+	}
+      g_string_append (message, "\n");
+    }
+
+  if (message->len)
+    send_to_engine (message);
+  else
+    g_string_free (message, TRUE);
+}
+
+/* Look up the strokes the engine holds; a prefix lookup asks for the
+ * characters they might be the start of.
+ */
+static void
+send_lookup (gboolean prefix)
+{
+  /*	     kill 'HUP',$engine_pid; */
+  GString *message = g_string_new (NULL);
+
+  sync_engine_strokes ();
+
+  if (prefix)
+    g_string_append (message, "PREFIX\n");
+  g_string_append (message, "QUERY\n");
+
+  send_to_engine (message);
+}
+
+static void 
+look_up_callback (GtkWidget *w)
+{
+  send_lookup (FALSE);
 }
 
 static void 
@@ -378,56 +515,65 @@ clear_callback (GtkWidget *w)
 }
 
 static void 
-save_callback (GtkWidget *w)
+undo_callback (GtkWidget *w)
 {
-  static int unknownID = 0;
-  static FILE *samples = NULL;
+  pad_area_undo (pad_area);
+}
 
-  int found = FALSE;
-  int i;
-  GList *tmp_list;
-  
-  if (!samples)
-    {
-      if (!(samples = fopen("samples.dat", "a")))
-	g_error ("Can't open 'samples.dat': %s", g_strerror(errno));
-    }
+/* Samples go to a background writer so saving never waits on the disk */
+static KpSampleRecorder *sample_recorder;
+
+static void
+close_samples ()
+{
+  if (sample_recorder)
+    kp_sample_recorder_free (sample_recorder);
+  sample_recorder = NULL;
+}
+
+static void 
+save_callback (GtkWidget *w)
+{
+  KpSample *sample;
+  guint i, j;
   
-  if (kselected.d[0] || kselected.d[1])
+  if (!sample_recorder)
     {
-      for (i=0; i<num_guesses; i++)
+      GError *err = NULL;
+
+      if (!(sample_recorder = kp_sample_recorder_new (SAMPLES_FILE, &err)))
 	{
-	  if (WCHAR_EQ (kselected, kanjiguess[i]))
-	    found = TRUE;
+	  g_printerr ("%s\n", err->message);
+	  g_error_free (err);
+	  return;
 	}
     }
   
-  if (found)
-    fprintf(samples,"%2x%2x %c%c\n", kselected.d[0], kselected.d[1],
-	   0x80 | kselected.d[0], 0x80 | kselected.d[1]);
-  else
+  sample = kp_sample_new ();
+
+  for (i=0; i<num_guesses; i++)
     {
-      fprintf (samples, "0000 ??%d\n", unknownID);
-      fprintf (stderr, "Unknown character saved, ID: %d\n", unknownID);
-      unknownID++;
+      g_array_append_val (sample->candidates, kanjiguess[i]);
+      if (kselected && kselected == kanjiguess[i])
+	sample->selected = kselected;
     }
 
-  tmp_list = pad_area->strokes;
-  while (tmp_list)
+  for (i = 0; i < pad_area->strokes->len; i++)
     {
-     GList *stroke_list = tmp_list->data;
-     while (stroke_list)
+     GArray *stroke = g_ptr_array_index (pad_area->strokes, i);
+     GArray *points = kp_sample_add_stroke (sample);
+
+     for (j = 0; j < stroke->len; j++)
        {
-	 gint16 x = ((GdkPoint *)stroke_list->data)->x;
-	 gint16 y = ((GdkPoint *)stroke_list->data)->y;
-	 fprintf(samples, "%d %d ", x, y);
-	 stroke_list = stroke_list->next;
+	 KpSamplePoint pt;
+
+	 pt.x = g_array_index (stroke, GdkPoint, j).x;
+	 pt.y = g_array_index (stroke, GdkPoint, j).y;
+	 g_array_append_val (points, pt);
        }
-     fprintf(samples, "\n");
-     tmp_list = tmp_list->next;
     }
-  fprintf(samples, "\n");
-  fflush(samples);
+
+  kp_sample_recorder_push (sample_recorder, sample);
 }
 
 static void
@@ -436,6 +582,26 @@ annotate_callback ()
   pad_area_set_annotate (pad_area, !pad_area->annotate);
 }
 
+static void
+autolookup_callback (gpointer data, guint action, GtkWidget *w)
+{
+  auto_lookup = gtk_check_menu_item_get_active (GTK_CHECK_MENU_ITEM (w));
+  assert( g_settings_set_boolean(kp_settings, "autolookup", auto_lookup) == TRUE );
+
+  if (!auto_lookup && auto_lookup_timeout)
+    {
+      g_source_remove (auto_lookup_timeout);
+      auto_lookup_timeout = 0;
+    }
+}
+
+static void
+completions_callback (gpointer data, guint action, GtkWidget *w)
+{
+  completions = gtk_check_menu_item_get_active (GTK_CHECK_MENU_ITEM (w));
+  assert( g_settings_set_boolean(kp_settings, "completions", completions) == TRUE );
+}
+
 static void
 fontselect_callback() {
     GtkWidget *w;
@@ -548,10 +714,41 @@ static void
 delegate_file () {
 }
 
+static gboolean
+auto_lookup_timeout_callback (gpointer data)
+{
+  auto_lookup_timeout = 0;
+
+  /* A new stroke has started; its pen-up will reschedule us */
+  if (pad_area->instroke)
+    return FALSE;
+
+  if (pad_area->strokes->len)
+    send_lookup (completions);
+
+  return FALSE;
+}
+
 void
 pad_area_changed_callback (PadArea *area)
 {
   update_sensitivity ();
+  sync_engine_strokes ();
+
+  /* Restart the timer on every pen-up, so a character written quickly
+   * is only looked up once the writer pauses. The engine keeps the
+   * scores of strokes it has already seen, so each lookup only pays
+   * for the new strokes.
+   */
+  if (auto_lookup_timeout)
+    {
+      g_source_remove (auto_lookup_timeout);
+      auto_lookup_timeout = 0;
+    }
+
+  if (auto_lookup && area->strokes->len)
+    auto_lookup_timeout = g_timeout_add (AUTO_LOOKUP_DELAY,
+					 auto_lookup_timeout_callback, NULL);
 }
 
 static void
@@ -565,14 +762,15 @@ update_path_sensitive (const gchar *path,
 static void
 update_sensitivity ()
 {
-  gboolean have_selected = (kselected.d[0] || kselected.d[1]);
-  gboolean have_strokes = (pad_area->strokes != NULL);
+  gboolean have_selected = (kselected);
+  gboolean have_strokes = (pad_area->strokes->len > 0);
 
   update_path_sensitive ("/Edit/Copy", have_selected);
   update_path_sensitive ("/Character/Lookup", have_strokes);
   gtk_widget_set_sensitive (lookup_button, have_strokes);
   update_path_sensitive ("/Character/Clear", have_strokes);
   gtk_widget_set_sensitive (clear_button, have_strokes);
+  update_path_sensitive ("/Character/Undo stroke", have_strokes);
   update_path_sensitive ("/Character/Save", have_strokes);
 }
 
@@ -605,20 +803,19 @@ engine_input_handler (GIOChannel *source, GIOCondition condition, gpointer data)
       break;
     }
 
-  if (line[0] == 'K')
+  /* 'P' is a list the engine cut short at its deadline */
+  if (line[0] == 'K' || line[0] == 'P')
     {
-      unsigned int t1, t2;
       p = line+1;
       for (i=0; i<MAX_GUESSES; i++)
 	{
 	  while (*p && isspace(*p)) p++;
-	  if (!*p || sscanf(p, "%2x%2x", &t1, &t2) != 2)
+	  if (!*p || !isxdigit(*p))
 	    {
 	      i--;
 	      break;
 	    }
-	  kanjiguess[i].d[0] = t1;
-	  kanjiguess[i].d[1] = t2;
+	  kanjiguess[i] = strtoul (p, NULL, 16);
 	  while (*p && !isspace(*p)) p++;
 	}
       num_guesses = i+1;
@@ -774,6 +971,13 @@ main (int argc, char **argv)
 
   pad_area = pad_area_create ();
 
+  auto_lookup = g_settings_get_boolean (kp_settings, "autolookup");
+  gtk_check_menu_item_set_active (GTK_CHECK_MENU_ITEM (gtk_item_factory_get_widget (factory, "/Character/Auto lookup")),
+				  auto_lookup);
+  completions = g_settings_get_boolean (kp_settings, "completions");
+  gtk_check_menu_item_set_active (GTK_CHECK_MENU_ITEM (gtk_item_factory_get_widget (factory, "/Character/Show completions")),
+				  completions);
+
   gtk_box_pack_start (GTK_BOX (main_hbox), pad_area->widget, TRUE, TRUE, 0);
   gtk_widget_show (pad_area->widget);
 
@@ -795,6 +999,8 @@ main (int argc, char **argv)
 		    G_CALLBACK (karea_expose_event), NULL);
   g_signal_connect (karea, "button_press_event",
 		    G_CALLBACK (karea_button_press_event), NULL);
+  g_signal_connect (karea, "style_set",
+		    G_CALLBACK (karea_style_set), NULL);
 
   gtk_widget_set_events (karea, GDK_EXPOSURE_MASK | GDK_BUTTON_PRESS_MASK);
 
@@ -844,6 +1050,8 @@ main (int argc, char **argv)
 
   gtk_main();
 
+  close_samples ();
+
   /* Close settings */
   g_settings_sync();
   g_free(kp_settings);
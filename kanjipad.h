@@ -6,16 +6,26 @@ struct _PadArea {
   GtkWidget *widget;
 
   gint annotate;
-  GList *strokes;
+  GPtrArray *strokes;		/* a GArray of GdkPoint per stroke */
 
   /* Private */
-  GdkPixmap *pixmap;
-  GList *curstroke;
+  GdkPixmap *pixmap;		/* ink layer, never shrinks */
+  gint pixmap_width, pixmap_height;
+  GArray *annotations;		/* a GdkRectangle per stroke */
+  GPtrArray *digit_layouts;	/* PangoLayout by stroke number */
+  GArray *curstroke;
   int instroke;
+  guint drawn;			/* last point of curstroke on the pixmap */
+  guint frame_source;
+
+  /* Redraw statistics */
+  gulong n_exposes;
+  guint64 expose_area;
 };
 
 PadArea *pad_area_create ();
 void pad_area_clear (PadArea *area);
+void pad_area_undo (PadArea *area);
 void pad_area_set_annotate (PadArea *area, gint annotate);
 
 void pad_area_changed_callback (PadArea *area);
@@ -0,0 +1,621 @@
+/* KanjiPad - Japanese handwriting recognition front end
+ * Copyright (C) 1997 Owen Taylor
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* Check the scorer against plain versions of the code its shortcuts
+ * replaced ("make check").  The queries are drawn from the dictionary
+ * itself: each stroke of a randomly picked entry is traced along its
+ * path's directions with some jitter, so that every stroke count is
+ * covered and the right answer is usually close to others.  With
+ * --bench, time the stroke scorer for each path length against the
+ * plain version instead ("make bench").
+ */
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <glib.h>
+
+#include "jstroke/jstroke.h"
+#include "jdata.h"
+
+/* Internal to scoring.c */
+ULong SqrtULong (ULong val);
+ULong StrokeScorerStrokeCost (StrokeScorer *pScorer, UInt iStroke,
+			      UInt iPathId);
+void StrokeScorerExtraFilters (StrokeScorer *pScorer, UInt iEntry,
+			       Byte *bpUser, ULong *ipScore);
+ULong StrokeDicScoreStroke (const StrokeScorerParams *pParams,
+			    Byte *bpX, Byte *bpY, Byte *bpCorner,
+			    UInt iLen, CharPtr cpPath, UInt iPathLen,
+			    UInt iDepth);
+
+#define MAX_ROOT ((ULong) 0xffff)
+#define MAX_SQUARED (MAX_ROOT * MAX_ROOT)
+#define HUGE_COST(params) \
+  (((24 * (params)->m_iAngCostScale) + (params)->m_iAngCostBase) * 100)
+
+#define QUERIES_PER_BUCKET 40
+#define RANDOM_ROOTS 4000000
+#define STROKES_PER_LENGTH 3000
+
+/* Path lengths scored by their own code, and the rest together */
+#define MAX_PATH_LEN 5
+
+static char *progname;
+static KpJData *jdata;
+static GRand *rng;
+static int failures;
+
+static void
+usage ()
+{
+  fprintf(stderr, "Usage: %s [-f/--data-file FILE] [-s/--seed N] [-b/--bench]\n",
+	  progname);
+  exit(1);
+}
+
+static void
+fail (const gchar *format, ...)
+{
+  va_list args;
+
+  fprintf(stderr, "%s: ", progname);
+  va_start (args, format);
+  vfprintf(stderr, format, args);
+  va_end (args);
+  fprintf(stderr, "\n");
+
+  failures++;
+}
+
+/* SqrtULong as it was, a binary search */
+static ULong
+old_sqrt (ULong val)
+{
+  ULong root, lo, hi;
+
+  if (val == 0)
+    return 0;
+  else if (val == 1)
+    return 1;
+  else if (val >= MAX_SQUARED)
+    return MAX_ROOT;
+
+  lo = 1;
+  hi = val >> 1;
+  if (hi > MAX_ROOT)
+    hi = MAX_ROOT;
+
+  while ((root = (lo + hi) >> 1) > lo)
+    {
+      if (root * root <= val)
+	lo = root;
+      else
+	hi = root;
+    }
+
+  return root;
+}
+
+static void
+check_root (ULong val)
+{
+  if (SqrtULong (val) != old_sqrt (val))
+    fail ("SqrtULong(%lu) is %lu, was %lu", val, SqrtULong (val),
+	  old_sqrt (val));
+}
+
+/* Every value below 2^24, either side of every square, the top of the
+ * range and a spread of random values.
+ */
+static void
+check_roots ()
+{
+  ULong val, r;
+  int d, i;
+
+  for (val = 0; val < (1 << 24) && failures < 10; val++)
+    check_root (val);
+
+  for (r = 1; r <= MAX_ROOT && failures < 10; r++)
+    for (d = -2; d <= 2; d++)
+      check_root (r * r + d);
+
+  for (val = MAX_SQUARED - 1000; val < MAX_SQUARED + 1000; val++)
+    check_root (val);
+
+  for (i = 0; i < RANDOM_ROOTS && failures < 10; i++)
+    check_root ((ULong)g_rand_int (rng) % (MAX_SQUARED + 1000));
+}
+
+/* Trace a path's directions from (x, y), a few pixels a point */
+static void
+trace_stroke (RawStroke *rs, const Byte *codes, guint n_codes)
+{
+  double x = g_rand_int_range (rng, 40, 216);
+  double y = g_rand_int_range (rng, 40, 216);
+  guint i;
+  int j, n;
+
+  rs->m_len = 0;
+  for (i = 0; i < n_codes; i++)
+    {
+      double a = (codes[i] + g_rand_double (rng) - 0.5) * 2 * G_PI / diAngCodes;
+
+      n = g_rand_int_range (rng, 3, 12);
+      for (j = (i > 0); j <= n && rs->m_len < diMaxXyPairs; j++)
+	{
+	  rs->m_x[rs->m_len] = CLAMP (x + g_rand_int_range (rng, -1, 2), 0, 255);
+	  rs->m_y[rs->m_len] = CLAMP (y + g_rand_int_range (rng, -1, 2), 0, 255);
+	  rs->m_len++;
+	  if (j < n)
+	    {
+	      x = CLAMP (x + 4 * sin (a), 0, 255);
+	      y = CLAMP (y - 4 * cos (a), 0, 255);
+	    }
+	}
+    }
+}
+
+/* Strokes for a random entry of dic */
+static void
+make_query (StrokeDic *dic, RawStroke *strokes)
+{
+  StrokePaths *paths = dic->m_pPaths;
+  guint entry = g_rand_int_range (rng, 0, dic->m_iEntryCnt);
+  guint i;
+
+  for (i = 0; i < dic->m_iStrokeCnt; i++)
+    {
+      guint id = dic->m_pPathIds[entry * dic->m_iStrokeCnt + i];
+
+      trace_stroke (&strokes[i], paths->m_bpCodes + id * diPathBufLen,
+		    paths->m_bpLen[id]);
+    }
+}
+
+/* StrokeDicScoreStroke before paths of one to four directions had
+ * scorers of their own: one recursion, halving the path, for every
+ * length.
+ */
+static ULong
+ref_score_stroke (const StrokeScorerParams *params, Byte *x, Byte *y,
+		  Byte *corner, UInt len, CharPtr path, UInt path_len,
+		  UInt depth)
+{
+  ULong score, this_score;
+  Long mid, step, path_mid, path_rest;
+  Long dx, dy;
+  Byte *split;
+
+  if (len < 2 || path_len < 1)
+    return HUGE_COST (params);
+
+  if (path_len == 1)
+    {
+      dx = x[len - 1] - x[0];
+      dy = y[0] - y[len - 1];
+
+      if (dx == 0 && dy == 0)
+	return HUGE_COST (params);
+
+      if ((ULong)(dx * dx + dy * dy) > params->m_iSplitDist * params->m_iSplitDist &&
+	  len > params->m_iSplitLen && depth < params->m_iSplitDepth)
+	{
+	  mid = len >> 1;
+	  score = ref_score_stroke (params, x, y, NULL, mid + 1,
+				    path, 1, depth + 1);
+	  score += ref_score_stroke (params, x + mid, y + mid, NULL, len - mid,
+				     path, 1, depth + 1);
+	  return score >> 1;
+	}
+
+      return params->m_aiAngCost[Angle32 (dx, dy)][(Byte)*path];
+    }
+
+  score = HUGE_COST (params) * path_len * 2;
+  path_mid = path_len >> 1;
+  path_rest = path_len - path_mid;
+
+  if (len < params->m_iStepLen || len < params->m_iStepDiv)
+    step = 1;
+  else
+    step = len / params->m_iStepDiv;
+
+  split = corner;
+  if (split)
+    {
+      for (mid = path_mid; mid < len - path_rest && !split[mid]; mid++)
+	;
+      if (mid < len - path_rest)
+	step = 1;
+      else
+	split = NULL;
+    }
+
+  for (mid = path_mid; mid < len - path_rest; mid += step)
+    {
+      if (split && !split[mid])
+	continue;
+
+      this_score = ref_score_stroke (params, x, y, corner, mid + 1,
+				     path, path_mid, depth + 1);
+      this_score += ref_score_stroke (params, x + mid, y + mid,
+				      corner ? corner + mid : NULL, len - mid,
+				      path + path_mid, path_rest, depth + 1);
+      this_score >>= 1;
+
+      if (this_score < score)
+	score = this_score;
+    }
+
+  return score;
+}
+
+/* A user stroke and a path to score it against */
+typedef struct {
+  RawStroke stroke;
+  Byte corner[diMaxXyPairs];
+  CharPtr path;
+  UInt path_len;
+} StrokeCase;
+
+/* Cases for each path length up to MAX_PATH_LEN, longer ones counting
+ * as MAX_PATH_LEN: a stroke traced along a path of that length, scored
+ * against another of the same length (half the time the same one), with
+ * random corner flags.
+ */
+static GArray *
+make_stroke_cases (guint path_len)
+{
+  StrokePaths *paths = jdata->paths;
+  GArray *ids = g_array_new (FALSE, FALSE, sizeof (guint));
+  GArray *cases = g_array_new (FALSE, FALSE, sizeof (StrokeCase));
+  guint i, j;
+
+  for (i = 0; i < paths->m_iCount; i++)
+    if (paths->m_bpLen[i] == path_len ||
+	(path_len == MAX_PATH_LEN && paths->m_bpLen[i] > path_len))
+      g_array_append_val (ids, i);
+
+  for (i = 0; ids->len && i < STROKES_PER_LENGTH; i++)
+    {
+      StrokeCase c;
+      guint id = g_array_index (ids, guint, g_rand_int_range (rng, 0, ids->len));
+
+      trace_stroke (&c.stroke, paths->m_bpCodes + id * diPathBufLen,
+		    paths->m_bpLen[id]);
+      if (g_rand_boolean (rng))
+	id = g_array_index (ids, guint, g_rand_int_range (rng, 0, ids->len));
+      c.path = (CharPtr) paths->m_bpCodes + id * diPathBufLen;
+      c.path_len = paths->m_bpLen[id];
+      for (j = 0; j < c.stroke.m_len; j++)
+	c.corner[j] = g_rand_int_range (rng, 0, 5) == 0;
+      g_array_append_val (cases, c);
+    }
+
+  g_array_free (ids, TRUE);
+  return cases;
+}
+
+/* Each path length's scorer against the plain recursion, with the
+ * built-in parameters, with stepping over split points and with
+ * corners.
+ */
+static void
+check_stroke_scores ()
+{
+  StrokeScorerParams params[3];
+  guint path_len, i, k;
+  int use_corners;
+
+  StrokeScorerParamsInit (&params[0]);
+  params[1] = params[0];
+  params[1].m_iStepLen = 5;
+  params[1].m_iStepDiv = 4;
+  params[2] = params[0];
+  params[2].m_iSplitDepth = 6;
+  params[2].m_iSplitLen = 2;
+
+  for (path_len = 1; path_len <= MAX_PATH_LEN; path_len++)
+    {
+      GArray *cases = make_stroke_cases (path_len);
+
+      for (i = 0; i < cases->len && failures < 10; i++)
+	{
+	  StrokeCase *c = &g_array_index (cases, StrokeCase, i);
+
+	  for (k = 0; k < G_N_ELEMENTS (params); k++)
+	    for (use_corners = 0; use_corners <= 1; use_corners++)
+	      {
+		Byte *corner = use_corners ? c->corner : NULL;
+		ULong got = StrokeDicScoreStroke (&params[k], c->stroke.m_x,
+						  c->stroke.m_y, corner,
+						  c->stroke.m_len, c->path,
+						  c->path_len, 0);
+		ULong want = ref_score_stroke (&params[k], c->stroke.m_x,
+					       c->stroke.m_y, corner,
+					       c->stroke.m_len, c->path,
+					       c->path_len, 0);
+
+		if (got != want)
+		  fail ("path of %u, case %u, params %u%s: scored %lu, expected %lu",
+			c->path_len, i, k, use_corners ? " with corners" : "",
+			got, want);
+	      }
+	}
+
+      g_array_free (cases, TRUE);
+    }
+}
+
+static double
+now_sec ()
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Run every case once with the scorer or the plain recursion, as many
+ * times as fit in a fifth of a second.  Returns usec per case.
+ */
+static double
+time_cases (GArray *cases, const StrokeScorerParams *params, gboolean plain)
+{
+  double start = now_sec (), elapsed;
+  volatile ULong sink = 0;
+  guint rounds = 0, i;
+
+  do
+    {
+      for (i = 0; i < cases->len; i++)
+	{
+	  StrokeCase *c = &g_array_index (cases, StrokeCase, i);
+
+	  if (plain)
+	    sink += ref_score_stroke (params, c->stroke.m_x, c->stroke.m_y,
+				      NULL, c->stroke.m_len, c->path,
+				      c->path_len, 0);
+	  else
+	    sink += StrokeDicScoreStroke (params, c->stroke.m_x, c->stroke.m_y,
+					  NULL, c->stroke.m_len, c->path,
+					  c->path_len, 0);
+	}
+      rounds++;
+    }
+  while ((elapsed = now_sec () - start) < 0.2);
+
+  return elapsed * 1e6 / ((double)rounds * cases->len);
+}
+
+static void
+bench_stroke_scores ()
+{
+  StrokeScorerParams params;
+  guint path_len;
+
+  StrokeScorerParamsInit (&params);
+
+  printf ("path   usec/stroke   usec/stroke\n");
+  printf ("length   (scorer)      (plain)    speedup\n");
+
+  for (path_len = 1; path_len <= MAX_PATH_LEN; path_len++)
+    {
+      GArray *cases = make_stroke_cases (path_len);
+      double scorer, plain;
+
+      if (!cases->len)
+	{
+	  g_array_free (cases, TRUE);
+	  continue;
+	}
+
+      /* Once each way first, to warm the caches */
+      time_cases (cases, &params, FALSE);
+      time_cases (cases, &params, TRUE);
+      scorer = time_cases (cases, &params, FALSE);
+      plain = time_cases (cases, &params, TRUE);
+
+      printf ("%s%-4u %10.3f    %10.3f    %6.2fx\n",
+	      path_len == MAX_PATH_LEN ? ">=" : "  ", path_len,
+	      scorer, plain, plain / scorer);
+      g_array_free (cases, TRUE);
+    }
+}
+
+/* The top picks as StrokeScorerEvalItem made them before it rejected
+ * entries on their squared score: every entry scored in full, the sum
+ * of its squared stroke scores rooted, then filtered, and entered in
+ * the list in visiting order, equal scores keeping the earlier entry
+ * first.
+ */
+static guint
+reference_picks (StrokeScorer *scorer, ScoreItem *picks)
+{
+  StrokeDic *dic = scorer->m_pDic;
+  guint n_picks = 0;
+  guint n, i, j;
+
+  for (n = 0; n < scorer->m_iVisitCnt; n++)
+    {
+      guint entry = scorer->m_piOrder ? scorer->m_piOrder[n] : n;
+      ULong sum = 0, score;
+
+      for (i = 0; i < dic->m_iStrokeCnt; i++)
+	{
+	  ULong cost = StrokeScorerStrokeCost (scorer, i,
+					       dic->m_pPathIds[entry * dic->m_iStrokeCnt + i]);
+
+	  cost = cost >= MAX_ROOT ? MAX_SQUARED : cost * cost;
+	  sum = sum >= MAX_SQUARED - cost ? MAX_SQUARED : sum + cost;
+	}
+
+      score = old_sqrt (sum);
+      if (dic->m_piFilters[entry] != dic->m_piFilters[entry + 1])
+	StrokeScorerExtraFilters (scorer, entry, NULL, &score);
+
+      for (i = n_picks; i > 0 && score < picks[i - 1].m_iScore; i--)
+	;
+      if (i == diMaxListCount)
+	continue;
+
+      if (n_picks < diMaxListCount)
+	n_picks++;
+      for (j = n_picks - 1; j > i; j--)
+	picks[j] = picks[j - 1];
+      picks[i].m_iScore = score;
+      picks[i].m_cp = dic->m_cppEntries[entry];
+    }
+
+  return n_picks;
+}
+
+/* Score the query in dictionary order, which sums blocks of entries,
+ * and in StrokeScorerOrder's order, which scores them one at a time.
+ */
+static void
+check_query (StrokeDic *dic, RawStroke *strokes, guint query)
+{
+  ScoreItem picks[diMaxListCount];
+  int ordered;
+  guint n_picks, i;
+
+  for (ordered = 0; ordered <= 1; ordered++)
+    {
+      StrokeScorer *scorer = StrokeScorerCreate (dic, strokes, dic->m_iStrokeCnt);
+      StrokeScorer *reference = StrokeScorerCreate (dic, strokes, dic->m_iStrokeCnt);
+
+      if (!scorer || !reference)
+	exit(1);
+
+      if (ordered)
+	StrokeScorerOrder (scorer);
+      StrokeScorerProcess (scorer, -1);
+
+      reference->m_piOrder = scorer->m_piOrder;
+      reference->m_iVisitCnt = scorer->m_iVisitCnt;
+      n_picks = reference_picks (reference, picks);
+      reference->m_piOrder = NULL;
+
+      if (n_picks != scorer->m_iScoreLen)
+	fail ("%u strokes, query %u%s: %u picks, expected %u",
+	      dic->m_iStrokeCnt, query, ordered ? " ordered" : "",
+	      scorer->m_iScoreLen, n_picks);
+      else
+	for (i = 0; i < n_picks; i++)
+	  if (picks[i].m_cp != scorer->m_pScores[i].m_cp ||
+	      picks[i].m_iScore != scorer->m_pScores[i].m_iScore)
+	    {
+	      fail ("%u strokes, query %u%s: pick %u is %.3s #%lu, expected %.3s #%lu",
+		    dic->m_iStrokeCnt, query, ordered ? " ordered" : "", i,
+		    scorer->m_pScores[i].m_cp, scorer->m_pScores[i].m_iScore,
+		    picks[i].m_cp, picks[i].m_iScore);
+	      break;
+	    }
+
+      StrokeScorerDestroy (reference);
+      StrokeScorerDestroy (scorer);
+    }
+}
+
+static void
+check_picks ()
+{
+  RawStroke strokes[diMaxStrokes];
+  guint nstrokes, i, n_queries = 0;
+
+  for (nstrokes = 1; nstrokes < diMaxStrokes; nstrokes++)
+    {
+      StrokeDic *dic = jdata->dicts[nstrokes];
+
+      if (!dic || !dic->m_iEntryCnt)
+	continue;
+
+      for (i = 0; i < QUERIES_PER_BUCKET; i++, n_queries++)
+	{
+	  make_query (dic, strokes);
+	  check_query (dic, strokes, i);
+	}
+    }
+
+  fprintf(stderr, "%s: compared top picks for %u queries\n", progname,
+	  n_queries);
+}
+
+int
+main (int argc, char **argv)
+{
+  const char *data_file = KP_LIBDIR G_DIR_SEPARATOR_S "jdata.dat";
+  guint32 seed = 1;
+  gboolean bench = FALSE;
+  GError *err = NULL;
+  int i;
+
+  progname = argv[0];
+
+  for (i = 1; i < argc; i++)
+    {
+      if ((!strcmp(argv[i], "--data-file") || !strcmp(argv[i], "-f")) &&
+	  i + 1 < argc)
+	data_file = argv[++i];
+      else if ((!strcmp(argv[i], "--seed") || !strcmp(argv[i], "-s")) &&
+	       i + 1 < argc)
+	seed = strtoul (argv[++i], NULL, 0);
+      else if (!strcmp(argv[i], "--bench") || !strcmp(argv[i], "-b"))
+	bench = TRUE;
+      else
+	usage ();
+    }
+
+  if (!(jdata = kp_jdata_load (data_file, &err)))
+    {
+      fprintf(stderr, "%s: %s\n", progname, err->message);
+      return 1;
+    }
+
+  rng = g_rand_new_with_seed (seed);
+
+  if (bench)
+    {
+      bench_stroke_scores ();
+      g_rand_free (rng);
+      kp_jdata_free (jdata);
+      return 0;
+    }
+
+  check_roots ();
+  check_stroke_scores ();
+  check_picks ();
+
+  g_rand_free (rng);
+  kp_jdata_free (jdata);
+
+  if (failures)
+    {
+      fprintf(stderr, "%s: %d failures\n", progname, failures);
+      return 1;
+    }
+
+  fprintf(stderr, "%s: all checks passed\n", progname);
+  return 0;
+}
@@ -23,100 +23,518 @@
 #include <errno.h>
 #include <glib.h>
 #include "jstroke/jstroke.h"
+#include "jdata.h"
+#include "profile.h"
 
 #define MAX_STROKES 32
 #define BUFLEN 1024
 
-static char *stroke_dicts[MAX_STROKES];
+/* Entries scored between deadline checks */
+#define DEADLINE_CHUNK 64
+
+/* Default memory for remembered results, in KB */
+#define CACHE_SIZE 1024
+
+static KpJData *jdata;
+static StrokeScorerParams params;
 static char *progname;
 static char *data_file;
+static char *profile_file;
+static long deadline;		/* msec per lookup, 0 for none */
+static long cache_size = CACHE_SIZE * 1024;	/* bytes, 0 for no cache */
 
-void
-load_database()
+/* The strokes of the previous lookup, and their cached path scores */
+static RawStroke session_strokes[MAX_STROKES];
+static StrokeCostCache *session_caches[MAX_STROKES];
+static int session_nstrokes;
+static int session_overflow;	/* strokes added past MAX_STROKES */
+
+/* Results of recent lookups, so that strokes sent again (a second press
+ * of Look up, a client retrying) are answered without scoring. Keyed by
+ * the strokes as parsed plus the options that change the result; the
+ * profile is fixed for the life of the engine. The queue holds the
+ * entries most recently used first; the table maps each key to its
+ * link in the queue.
+ */
+typedef struct {
+  GString *key;
+  gchar *result;		/* The line sent, without its newline */
+} CachedResult;
+
+static GHashTable *result_cache;
+static GQueue *result_queue;
+static gsize result_cache_bytes;
+static gulong result_cache_hits;
+static gulong result_cache_misses;
+
+static gsize
+cached_result_bytes (CachedResult *cached)
+{
+  return sizeof (CachedResult) + cached->key->len + strlen (cached->result);
+}
+
+static GString *
+result_key (RawStroke *strokes, int nstrokes, int prefix)
 {
-  FILE *file;
+  GString *key = g_string_sized_new (64);
   int i;
 
-  if (data_file)
+  g_string_append_c (key, prefix ? 'P' : 'K');
+  for (i=0; i<nstrokes; i++)
     {
-      file = fopen (data_file, "rb");
+      g_string_append_c (key, strokes[i].m_len & 0xff);
+      g_string_append_c (key, strokes[i].m_len >> 8);
+      g_string_append_len (key, (gchar *)strokes[i].m_x, strokes[i].m_len);
+      g_string_append_len (key, (gchar *)strokes[i].m_y, strokes[i].m_len);
     }
-  else
+
+  return key;
+}
+
+static const gchar *
+result_cache_lookup (GString *key)
+{
+  GList *link;
+
+  if (!result_cache)
+    return NULL;
+
+  link = g_hash_table_lookup (result_cache, key);
+  if (!link)
     {
-#ifdef G_OS_WIN32
-      char *dir = g_win32_get_package_installation_directory (NULL, NULL);
-#else
-      char *dir = g_strdup (KP_LIBDIR);
-#endif      
-      char *fname = g_build_filename (dir, "jdata.dat", NULL);
-      file = fopen (fname, "rb");
-      
-      if (!file)
-	file = fopen ("jdata.dat", "rb");
+      result_cache_misses++;
+      return NULL;
+    }
+
+  result_cache_hits++;
+  g_queue_unlink (result_queue, link);
+  g_queue_push_head_link (result_queue, link);
+
+  return ((CachedResult *)link->data)->result;
+}
+
+/* Remember result for key, which the cache takes over */
+static void
+result_cache_insert (GString *key, const gchar *result)
+{
+  CachedResult *cached;
+  GList *link;
+
+  if (!result_cache)
+    {
+      g_string_free (key, TRUE);
+      return;
+    }
 
-      g_free (fname);
-      g_free (dir);
+  cached = g_new (CachedResult, 1);
+  cached->key = key;
+  cached->result = g_strdup (result);
+  result_cache_bytes += cached_result_bytes (cached);
+
+  link = g_list_alloc ();
+  link->data = cached;
+  g_queue_push_head_link (result_queue, link);
+  g_hash_table_insert (result_cache, key, link);
+
+  while (result_cache_bytes > (gsize)cache_size)
+    {
+      link = g_queue_pop_tail_link (result_queue);
+      cached = link->data;
+      g_hash_table_remove (result_cache, cached->key);
+      result_cache_bytes -= cached_result_bytes (cached);
+      g_string_free (cached->key, TRUE);
+      g_free (cached->result);
+      g_free (cached);
+      g_list_free_1 (link);
     }
+}
+
+void
+load_database()
+{
+  GError *err = NULL;
+  int i;
 
-  if (!file)
+  StrokeScorerParamsInit (&params);
+  if (profile_file && !kp_profile_load (profile_file, &params, &err))
     {
-      fprintf(stderr,"%s: Can't open %s\n", progname,
-	      data_file ? data_file : "jdata.dat");
+      fprintf(stderr, "%s: %s\n", progname, err->message);
       exit(1);
     }
 
+  jdata = kp_jdata_load (data_file, &err);
+  if (!jdata)
+    {
+      fprintf(stderr, "%s: %s\n", progname, err->message);
+      exit(1);
+    }
 
   for (i=0;i<MAX_STROKES;i++)
-    stroke_dicts[i] = NULL;
+    {
+      session_caches[i] = StrokeCostCacheCreate (jdata->paths);
+      if (!session_caches[i])
+	exit(1);
+    }
 
-  while (1)
+  if (cache_size > 0)
     {
-      int n_read;
-      unsigned int nstrokes;
-      unsigned int len;
-      int buf[2];
+      result_cache = g_hash_table_new ((GHashFunc)g_string_hash,
+				       (GEqualFunc)g_string_equal);
+      result_queue = g_queue_new ();
+    }
+}
 
-      n_read = fread (buf, sizeof(int), 2, file);
-      
-      nstrokes = GUINT32_FROM_BE(buf[0]);
-      len = GUINT32_FROM_BE(buf[1]);
+static int
+stroke_equal (RawStroke *a, RawStroke *b)
+{
+  return a->m_len == b->m_len &&
+    !memcmp (a->m_x, b->m_x, a->m_len) &&
+    !memcmp (a->m_y, b->m_y, a->m_len);
+}
 
-      if ((n_read != 2) || (nstrokes > MAX_STROKES))
+/* Strokes that are the same as in the previous lookup keep their cached
+ * path scores, so when the user adds a stroke and looks up again only
+ * the new stroke needs scoring.
+ */
+static void
+session_update (RawStroke *strokes, int nstrokes)
+{
+  int i;
+  int same = TRUE;
+
+  for (i=0; i<nstrokes; i++)
+    {
+      same = same && i < session_nstrokes &&
+	stroke_equal (&strokes[i], &session_strokes[i]);
+
+      if (!same)
 	{
-	  fprintf(stderr, "%s: Corrupt stroke database\n", progname);
-	  exit(1);
+	  session_strokes[i] = strokes[i];
+	  StrokeCostCacheReset (session_caches[i]);
 	}
+    }
 
-      if (nstrokes == 0)
-	break;
+  session_nstrokes = nstrokes;
+  session_overflow = 0;
+}
+
+/* The stroke count of the bucket tried n'th for a lookup of nstrokes
+ * strokes: nstrokes itself, then one fewer, one more, two fewer and so
+ * on, for users who break strokes in two or join them. A prefix lookup,
+ * for the characters the strokes so far might be the start of, tries
+ * every bucket from nstrokes up instead.
+ */
+static int
+bucket_strokes (int nstrokes, int n, int prefix)
+{
+  if (prefix)
+    return nstrokes + n;
+  return nstrokes + ((n + 1) / 2) * ((n & 1) ? -1 : 1);
+}
 
-      stroke_dicts[nstrokes] = malloc(len);
-      n_read = fread(stroke_dicts[nstrokes], 1, len, file);
+static int
+n_buckets (int nstrokes, int prefix)
+{
+  return prefix ? MAX_STROKES - nstrokes : 2 * params.m_iStrokeEdits + 1;
+}
+
+static int
+has_buckets (int nstrokes, int prefix)
+{
+  int n, bucket;
+
+  for (n = 0; n < n_buckets (nstrokes, prefix); n++)
+    {
+      bucket = bucket_strokes (nstrokes, n, prefix);
+      if (bucket > 0 && bucket < MAX_STROKES && jdata->dicts[bucket])
+	return TRUE;
+    }
+  return FALSE;
+}
+
+/* Score the session strokes against each bucket in turn, every scorer
+ * starting from the list of the one before, and return the last.  Sets
+ * *remaining nonzero if the deadline cut the lookup short.
+ */
+static StrokeScorer *
+score_buckets (int nstrokes, int prefix, long query_deadline, long *remaining)
+{
+  StrokeScorer *scorer = NULL, *next;
+  gint64 end_time = g_get_monotonic_time () + query_deadline * 1000;
+  int n, bucket, i;
+
+  *remaining = 0;
+  for (n = 0; n < n_buckets (nstrokes, prefix); n++)
+    {
+      bucket = bucket_strokes (nstrokes, n, prefix);
+      if (bucket <= 0 || bucket >= MAX_STROKES || !jdata->dicts[bucket])
+	continue;
 
-      if (n_read != len)
+      if (query_deadline > 0 && g_get_monotonic_time () >= end_time)
 	{
-	  fprintf(stderr, "%s: Corrupt stroke database", progname);
-	  exit(1);
+	  *remaining = 1;
+	  break;
+	}
+
+      next = StrokeScorerCreate (jdata->dicts[bucket], session_strokes, nstrokes);
+      if (!next)
+	continue;
+
+      StrokeScorerSetParams (next, &params);
+
+      for (i=0; i<nstrokes; i++)
+	StrokeScorerSetCache (next, i, session_caches[i]);
+
+      if (prefix)
+	StrokeScorerPrefix (next);
+
+      if (scorer)
+	{
+	  StrokeScorerSeed (next, scorer);
+	  StrokeScorerDestroy (scorer);
+	}
+      scorer = next;
+
+      if (query_deadline > 0)
+	{
+	  /* Score in chunks, likeliest entries first, and settle
+	   * for what we have when the time is up.
+	   */
+	  if (!prefix)
+	    StrokeScorerOrder(scorer);
+	  do
+	    *remaining = StrokeScorerProcess(scorer, DEADLINE_CHUNK);
+	  while (*remaining && g_get_monotonic_time () < end_time);
+	  if (*remaining)
+	    break;
 	}
+      else
+	StrokeScorerProcess(scorer, -1);
     }
-  
-  fclose (file);
+
+  return scorer;
 }
 
-/* From Ken Lunde's _Understanding Japanese Information Processing_
-   O'Reilly, 1993 */
+/* Read the points of a stroke, all strung together on one line, into
+ * stroke. Returns the number of points.
+ */
+static int
+parse_stroke (char *p, RawStroke *stroke)
+{
+  char *q;
+  int len = 0;
+
+  while (len < diMaxXyPairs) {
+    while (isspace (*p)) p++;
+    if (*p == 0)
+      break;
+    stroke->m_x[len] = strtol (p, &q, 0);
+    if (p == q)
+      break;
+    p = q;
+	  
+    while (isspace (*p)) p++;
+    if (*p == 0)
+      break;
+    stroke->m_y[len] = strtol (p, &q, 0);
+    if (p == q)
+      break;
+    p = q;
+	
+    len++;
+  }
+
+  stroke->m_len = len;
+  return len;
+}
 
-void 
-sjis2jis(unsigned char *p1, unsigned char *p2)
+/* Look up nstrokes strokes and send the result. Returns FALSE, having
+ * sent nothing, if no bucket could hold the character.
+ */
+static int
+look_up (RawStroke *strokes, int nstrokes, int prefix, long query_deadline)
 {
-  unsigned char c1 = *p1;
-  unsigned char c2 = *p2;
-  int adjust = c2 < 159;
-  int rowOffset = c1 < 160 ? 112 : 176;
-  int cellOffset = adjust ? (c2 > 127 ? 32 : 31) : 126;
-  
-  *p1 = ((c1 - rowOffset) << 1) - adjust;
-  *p2 -= cellOffset;  
+  int i;
+  ListMem *top_picks;
+  StrokeScorer *scorer;
+  long remaining;
+  GString *key;
+  const gchar *result;
+
+  if (!has_buckets (nstrokes, prefix))
+    return FALSE;
+
+  /* Even a lookup answered from the cache replaces the strokes kept */
+  session_update (strokes, nstrokes);
+
+  key = result_key (strokes, nstrokes, prefix);
+  if ((result = result_cache_lookup (key)))
+    {
+      g_string_free (key, TRUE);
+      printf("%s\n", result);
+      fflush(stdout);
+      return TRUE;
+    }
+
+  scorer = score_buckets (nstrokes, prefix, query_deadline, &remaining);
+  if (scorer)
+    {
+      GString *line = g_string_new (NULL);
+
+      top_picks = StrokeScorerTopPicks(scorer);
+      StrokeScorerDestroy(scorer);
+	  
+      /* 'P' marks a partial list cut short by the deadline */
+      g_string_append_c (line, remaining ? 'P' : 'K');
+      for (i=0;i<top_picks->m_argc;i++)
+	{
+	  if (i)
+	    g_string_append_c (line, ' ');
+	  g_string_append_printf (line, "%x",
+				  g_utf8_get_char (top_picks->m_argv[i]));
+	}
+	  
+      free(top_picks);
+
+      /* A partial list would be a worse answer than scoring again */
+      printf("%s", line->str);
+      if (!remaining)
+	{
+	  result_cache_insert (key, line->str);
+	  key = NULL;
+	}
+      g_string_free (line, TRUE);
+    }
+  if (key)
+    g_string_free (key, TRUE);
+  printf("\n");
+
+  fflush(stdout);
+
+  return TRUE;
+}
+
+/* Handle a line starting with a keyword rather than a point. Returns
+ * FALSE for an unknown keyword. The options, each for the next lookup
+ * only, are:
+ *
+ *   DEADLINE msec		settle for the best list found in msec
+ *   PREFIX			list characters the strokes may be the start of
+ *
+ * A prefix lookup scores each entry's first strokes against the user's
+ * in the order drawn, one for one: the profile's rotate, order_free,
+ * stroke_edits and pyramid_keep don't apply, nor do the entries' extra
+ * filters, and under a deadline entries are visited grouped by their
+ * first strokes rather than likeliest first.
+ *
+ * Besides the options for the next lookup, a client may keep the strokes
+ * in the engine, sending each as it is drawn, and ask for lookups of
+ * them as they stand:
+ *
+ *   ADD_STROKE x y x y ...	add a stroke
+ *   UNDO_STROKE		take back the last one
+ *   CLEAR			take back all of them
+ *   QUERY			look them up, with the options given before
+ *
+ * Only QUERY is answered, always with one line. Strokes already scored
+ * keep their path scores, so each lookup only pays for what changed. A
+ * lookup sent the old way, as whole strokes ending in a blank line,
+ * replaces the strokes kept.
+ *
+ * Every ADD_STROKE counts as a stroke, so that a client counting what it
+ * sent can always take strokes back with UNDO_STROKE; but while any
+ * stroke kept has no points, or there are more than MAX_STROKES, QUERY
+ * finds nothing.
+ */
+static int
+process_directive (char *line, long *query_deadline, int *prefix)
+{
+  char *p = line;
+
+  while (*p && !isspace (*p)) p++;
+
+  if (p - line == 8 && !strncmp (line, "DEADLINE", 8))
+    {
+      *query_deadline = strtol (p, NULL, 0);
+      return TRUE;
+    }
+  else if (p - line == 6 && !strncmp (line, "PREFIX", 6))
+    {
+      static int warned = FALSE;
+
+      if (!warned && (params.m_iRotate || params.m_iOrderFree ||
+		      params.m_iStrokeEdits || params.m_iPyramidKeep))
+	{
+	  fprintf (stderr, "%s: prefix lookups ignore the profile's rotate, "
+		   "order_free, stroke_edits and pyramid_keep\n", progname);
+	  warned = TRUE;
+	}
+      *prefix = TRUE;
+      return TRUE;
+    }
+  else if (p - line == 10 && !strncmp (line, "ADD_STROKE", 10))
+    {
+      RawStroke stroke;
+
+      if (session_nstrokes == MAX_STROKES)
+	session_overflow++;
+      else
+	{
+	  parse_stroke (p, &stroke);
+	  /* A stroke taken back and drawn again the same way, as when
+	   * the pad is redrawn, keeps its scores */
+	  if (!stroke_equal (&stroke, &session_strokes[session_nstrokes]))
+	    {
+	      session_strokes[session_nstrokes] = stroke;
+	      StrokeCostCacheReset (session_caches[session_nstrokes]);
+	    }
+	  session_nstrokes++;
+	}
+      return TRUE;
+    }
+  else if (p - line == 11 && !strncmp (line, "UNDO_STROKE", 11))
+    {
+      if (session_overflow > 0)
+	session_overflow--;
+      else if (session_nstrokes > 0)
+	session_nstrokes--;
+      return TRUE;
+    }
+  else if (p - line == 5 && !strncmp (line, "CLEAR", 5))
+    {
+      session_nstrokes = 0;
+      session_overflow = 0;
+      return TRUE;
+    }
+  else if (p - line == 5 && !strncmp (line, "QUERY", 5))
+    {
+      int i, empty = FALSE;
+
+      for (i=0; i<session_nstrokes; i++)
+	empty = empty || !session_strokes[i].m_len;
+
+      if (!session_nstrokes || session_overflow || empty ||
+	  !look_up (session_strokes, session_nstrokes, *prefix, *query_deadline))
+	{
+	  printf ("K\n");
+	  fflush (stdout);
+	}
+      *prefix = FALSE;
+      *query_deadline = deadline;
+      return TRUE;
+    }
+  else if (p - line == 5 && !strncmp (line, "STATS", 5))
+    {
+      /* Answered at once, on a line of its own starting with 'S' */
+      printf ("S hits %lu misses %lu entries %u bytes %lu\n",
+	      result_cache_hits, result_cache_misses,
+	      result_queue ? result_queue->length : 0,
+	      (gulong)result_cache_bytes);
+      fflush (stdout);
+      return TRUE;
+    }
+
+  return FALSE;
 }
 
 int
@@ -126,15 +544,18 @@ process_strokes (FILE *file)
   char *buffer = malloc(BUFLEN);
   int buflen = BUFLEN;
   int nstrokes = 0;
+  long query_deadline = deadline;
+  int prefix = FALSE;
 
   /* Read in strokes from standard in, all points for each stroke
-   *  strung together on one line, until we get a blank line
+   * strung together on one line, until we get a blank line. A line
+   * starting with a keyword sets an option for this lookup only, or
+   * is one of the commands of process_directive.
    */
   
   while (1)
     {
-      char *p,*q;
-      int len;
+      char *p;
 
       if (!fgets(buffer, buflen, file))
 	return 0;
@@ -147,75 +568,36 @@ process_strokes (FILE *file)
 	    return 0;
 	}
       
-      len = 0;
       p = buffer;
+
+      while (isspace (*p)) p++;
+      if (isalpha (*p))
+	{
+	  if (!process_directive (p, &query_deadline, &prefix))
+	    fprintf (stderr, "%s: Unknown directive: %s", progname, p);
+	  continue;
+	}
       
-      while (1) {
-	while (isspace (*p)) p++;
-	if (*p == 0)
-	  break;
-	strokes[nstrokes].m_x[len] = strtol (p, &q, 0);
-	if (p == q)
-	  break;
-	p = q;
-	  
-	while (isspace (*p)) p++;
-	if (*p == 0)
-	  break;
-	strokes[nstrokes].m_y[len] = strtol (p, &q, 0);
-	if (p == q)
-	  break;
-	p = q;
-	
-	len++;
-      }
-      
-      if (len == 0)
+      if (!parse_stroke (p, &strokes[nstrokes]))
 	break;
       
-      strokes[nstrokes].m_len = len;
       nstrokes++;
       if (nstrokes == MAX_STROKES)
 	break;
     }
   
-  if (nstrokes != 0 && stroke_dicts[nstrokes])
-    {
-      int i;
-      ListMem *top_picks;
-      StrokeScorer *scorer = StrokeScorerCreate (stroke_dicts[nstrokes],
-						 strokes, nstrokes);
-      if (scorer)
-	{
-	  StrokeScorerProcess(scorer, -1);
-	  top_picks = StrokeScorerTopPicks(scorer);
-	  StrokeScorerDestroy(scorer);
-	  
-	  printf("K");
-	  for (i=0;i<top_picks->m_argc;i++)
-	    {
-	      unsigned char c[2];
-	      if (i)
-		printf(" ");
-	      c[0] = top_picks->m_argv[i][0];
-	      c[1] = top_picks->m_argv[i][1];
-	      sjis2jis(&c[0],&c[1]);
-	      printf("%2x%2x",c[0],c[1]);
-	    }
-	  
-	  free(top_picks);
-	}
-      printf("\n");
+  if (nstrokes != 0)
+    look_up (strokes, nstrokes, prefix, query_deadline);
 
-      fflush(stdout);
-    }
   return 1;
 }
 
 void
 usage ()
 {
-  fprintf(stderr, "Usage: %s [-f/--data-file FILE]\n", progname);
+  fprintf(stderr, "Usage: %s [-f/--data-file FILE] [-p/--profile FILE]\n"
+	  "          [-d/--deadline MSEC] [-c/--cache-size KB]\n",
+	  progname);
   exit (1);
 }
 
@@ -241,6 +623,33 @@ real_main(int argc, char **argv)
 	  else
 	    usage();
 	}
+      else if (!strcmp(argv[i], "--profile") ||
+	       !strcmp(argv[i], "-p"))
+	{
+	  i++;
+	  if (i < argc)
+	    profile_file = argv[i];
+	  else
+	    usage();
+	}
+      else if (!strcmp(argv[i], "--deadline") ||
+	       !strcmp(argv[i], "-d"))
+	{
+	  i++;
+	  if (i < argc)
+	    deadline = strtol(argv[i], NULL, 0);
+	  else
+	    usage();
+	}
+      else if (!strcmp(argv[i], "--cache-size") ||
+	       !strcmp(argv[i], "-c"))
+	{
+	  i++;
+	  if (i < argc)
+	    cache_size = strtol(argv[i], NULL, 0) * 1024;
+	  else
+	    usage();
+	}
       else
 	{
 	  usage();
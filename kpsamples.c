@@ -0,0 +1,344 @@
+/* KanjiPad - Japanese handwriting recognition front end
+ * Copyright (C) 1997 Owen Taylor
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* Convert between the binary sample files kanjipad records, the old
+ * samples.dat text format that runtest.pl reads, and indexed corpus
+ * files (corpus.h) for tools that need random access.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "samples.h"
+#include "corpus.h"
+
+static char *progname;
+
+static void
+usage ()
+{
+  fprintf(stderr, "Usage: %s import FILE.kps [SAMPLES.DAT...]\n", progname);
+  fprintf(stderr, "       %s export FILE.kps\n", progname);
+  fprintf(stderr, "       %s pack FILE.kpc SAMPLES...\n", progname);
+  fprintf(stderr, "       %s info FILE.kpc\n", progname);
+  fprintf(stderr, "       %s lookup FILE.kpc CHAR\n", progname);
+  fprintf(stderr, "       %s shard FILE.kpc N I\n", progname);
+  fprintf(stderr, "Import appends text samples (stdin if no files are given)\n");
+  fprintf(stderr, "to a sample file; export writes them as text to stdout.\n");
+  fprintf(stderr, "Pack builds a corpus from sample files in either format.\n");
+  fprintf(stderr, "Lookup writes the samples of CHAR (a character or U+XXXX)\n");
+  fprintf(stderr, "and shard the I'th of N even parts of a corpus as text.\n");
+  exit(1);
+}
+
+static int
+import_file (KpSampleRecorder *recorder, FILE *file)
+{
+  KpSample *sample;
+  int count = 0;
+
+  while ((sample = kp_sample_read_text (file)))
+    {
+      kp_sample_recorder_push (recorder, sample);
+      count++;
+    }
+
+  return count;
+}
+
+static int
+do_import (const char *out, int nfiles, char **files)
+{
+  KpSampleRecorder *recorder;
+  GError *err = NULL;
+  int count = 0;
+  int i;
+
+  recorder = kp_sample_recorder_new (out, &err);
+  if (!recorder)
+    {
+      fprintf(stderr, "%s: %s\n", progname, err->message);
+      return 1;
+    }
+
+  if (nfiles == 0)
+    count += import_file (recorder, stdin);
+
+  for (i = 0; i < nfiles; i++)
+    {
+      FILE *file = fopen (files[i], "r");
+
+      if (!file)
+	{
+	  fprintf(stderr, "%s: Can't open %s\n", progname, files[i]);
+	  kp_sample_recorder_free (recorder);
+	  return 1;
+	}
+      count += import_file (recorder, file);
+      fclose (file);
+    }
+
+  kp_sample_recorder_free (recorder);
+  fprintf(stderr, "%s: %d samples imported\n", progname, count);
+
+  return 0;
+}
+
+static int
+do_export (const char *in)
+{
+  const guchar *p, *end;
+  gchar *contents;
+  gsize length;
+  GError *err = NULL;
+  int unknown_id = 0;
+
+  if (!kp_sample_file_load (in, &contents, &length, &err))
+    {
+      fprintf(stderr, "%s: %s\n", progname, err->message);
+      return 1;
+    }
+
+  p = (const guchar *)contents + KP_SAMPLE_MAGIC_LEN;
+  end = (const guchar *)contents + length;
+  while (p < end)
+    {
+      KpSample *sample = kp_sample_decode (&p, end);
+
+      if (!sample)
+	{
+	  fprintf(stderr, "%s: %s: corrupt record at offset %ld\n", progname,
+		  in, (long)(p - (const guchar *)contents));
+	  g_free (contents);
+	  return 1;
+	}
+      kp_sample_write_text (sample, stdout, sample->selected ? 0 : unknown_id++);
+      kp_sample_free (sample);
+    }
+
+  g_free (contents);
+
+  return 0;
+}
+
+static int
+pack_file (KpCorpusWriter *writer, const char *in)
+{
+  char magic[KP_SAMPLE_MAGIC_LEN];
+  KpSample *sample;
+  FILE *file;
+  int count = 0;
+
+  if (!(file = fopen (in, "rb")))
+    {
+      fprintf(stderr, "%s: Can't open %s\n", progname, in);
+      return -1;
+    }
+
+  if (fread (magic, 1, KP_SAMPLE_MAGIC_LEN, file) == KP_SAMPLE_MAGIC_LEN &&
+      !memcmp (magic, KP_SAMPLE_MAGIC, KP_SAMPLE_MAGIC_LEN))
+    {
+      const guchar *p, *end;
+      gchar *contents;
+      gsize length;
+      GError *err = NULL;
+
+      fclose (file);
+      if (!kp_sample_file_load (in, &contents, &length, &err))
+	{
+	  fprintf(stderr, "%s: %s\n", progname, err->message);
+	  return -1;
+	}
+
+      p = (const guchar *)contents + KP_SAMPLE_MAGIC_LEN;
+      end = (const guchar *)contents + length;
+      while (p < end && (sample = kp_sample_decode (&p, end)))
+	{
+	  kp_corpus_writer_add (writer, sample);
+	  kp_sample_free (sample);
+	  count++;
+	}
+      g_free (contents);
+
+      if (p < end)
+	{
+	  fprintf(stderr, "%s: %s: corrupt record\n", progname, in);
+	  return -1;
+	}
+      return count;
+    }
+
+  rewind (file);
+  while ((sample = kp_sample_read_text (file)))
+    {
+      kp_corpus_writer_add (writer, sample);
+      kp_sample_free (sample);
+      count++;
+    }
+  fclose (file);
+
+  return count;
+}
+
+static int
+do_pack (const char *out, int nfiles, char **files)
+{
+  KpCorpusWriter *writer = kp_corpus_writer_new ();
+  GError *err = NULL;
+  int count = 0;
+  int i, n;
+
+  for (i = 0; i < nfiles; i++)
+    {
+      if ((n = pack_file (writer, files[i])) < 0)
+	{
+	  kp_corpus_writer_free (writer);
+	  return 1;
+	}
+      count += n;
+    }
+
+  if (!kp_corpus_writer_save (writer, out, &err))
+    {
+      fprintf(stderr, "%s: %s\n", progname, err->message);
+      kp_corpus_writer_free (writer);
+      return 1;
+    }
+
+  kp_corpus_writer_free (writer);
+  fprintf(stderr, "%s: %d samples packed\n", progname, count);
+
+  return 0;
+}
+
+static KpCorpus *
+open_corpus (const char *in)
+{
+  KpCorpus *corpus;
+  GError *err = NULL;
+
+  if (!(corpus = kp_corpus_open (in, &err)))
+    {
+      fprintf(stderr, "%s: %s\n", progname, err->message);
+      exit(1);
+    }
+
+  return corpus;
+}
+
+/* Write samples first .. first + count - 1 of a corpus as text */
+static int
+export_range (KpCorpus *corpus, guint first, guint count)
+{
+  int unknown_id = 0;
+  guint i;
+
+  for (i = first; i < first + count; i++)
+    {
+      KpSample *sample = kp_corpus_get (corpus, i);
+
+      if (!sample)
+	{
+	  fprintf(stderr, "%s: corrupt record %u\n", progname, i);
+	  return 1;
+	}
+      kp_sample_write_text (sample, stdout, sample->selected ? 0 : unknown_id++);
+      kp_sample_free (sample);
+    }
+
+  return 0;
+}
+
+static int
+do_info (const char *in)
+{
+  KpCorpus *corpus = open_corpus (in);
+  guint first, count;
+
+  printf ("%u samples\n", kp_corpus_n_samples (corpus));
+  printf ("%u characters\n", kp_corpus_n_chars (corpus));
+  kp_corpus_find_char (corpus, 0, &first, &count);
+  printf ("%u unlabelled\n", count);
+
+  kp_corpus_close (corpus);
+
+  return 0;
+}
+
+static int
+do_lookup (const char *in, const char *ch_str)
+{
+  KpCorpus *corpus = open_corpus (in);
+  guint first, count;
+  gunichar ch;
+  int result;
+
+  if (ch_str[0] == 'U' && ch_str[1] == '+')
+    ch = strtoul (ch_str + 2, NULL, 16);
+  else
+    ch = g_utf8_get_char (ch_str);
+
+  kp_corpus_find_char (corpus, ch, &first, &count);
+  result = export_range (corpus, first, count);
+  kp_corpus_close (corpus);
+
+  return result;
+}
+
+static int
+do_shard (const char *in, const char *n_str, const char *i_str)
+{
+  KpCorpus *corpus;
+  guint first, count;
+  int n = atoi (n_str), i = atoi (i_str);
+  int result;
+
+  if (n <= 0 || i < 0 || i >= n)
+    usage ();
+
+  corpus = open_corpus (in);
+  kp_corpus_shard (corpus, n, i, &first, &count);
+  result = export_range (corpus, first, count);
+  kp_corpus_close (corpus);
+
+  return result;
+}
+
+int
+main (int argc, char **argv)
+{
+  progname = argv[0];
+
+  if (argc >= 3 && !strcmp (argv[1], "import"))
+    return do_import (argv[2], argc - 3, argv + 3);
+  else if (argc == 3 && !strcmp (argv[1], "export"))
+    return do_export (argv[2]);
+  else if (argc >= 4 && !strcmp (argv[1], "pack"))
+    return do_pack (argv[2], argc - 3, argv + 3);
+  else if (argc == 3 && !strcmp (argv[1], "info"))
+    return do_info (argv[2]);
+  else if (argc == 4 && !strcmp (argv[1], "lookup"))
+    return do_lookup (argv[2], argv[3]);
+  else if (argc == 5 && !strcmp (argv[1], "shard"))
+    return do_shard (argv[2], argv[3], argv[4]);
+
+  usage ();
+  return 1;
+}
@@ -0,0 +1,449 @@
+/* KanjiPad - Japanese handwriting recognition front end
+ * Copyright (C) 1997 Owen Taylor
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* Fit the scorer parameters (see profile.h) to a labelled corpus.
+ * Starting from the built-in values, or a given profile, each parameter
+ * in turn is set to every value on its grid while the others are held,
+ * and the value giving the most correct first choices, then the most
+ * correct choices in the top five, is kept; rounds repeat until nothing
+ * changes.  Values whose mean lookup time exceeds the budget are not
+ * considered.  Each evaluation is split across worker threads.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <glib.h>
+
+#include "jstroke/jstroke.h"
+#include "corpus.h"
+#include "jdata.h"
+#include "profile.h"
+
+#define DEFAULT_ROUNDS 3
+
+/* Values tried for each key of kp_profile_keys, ending with -1 */
+static const struct {
+  const gchar *key;
+  glong values[12];
+} grids[] = {
+  { "ang_cost_base",  { 0, 13, 26, 39, 52, 65, 78, 104, -1 } },
+  { "ang_cost_scale", { 49, 74, 86, 98, 110, 122, 147, -1 } },
+  { "split_dist",     { 10, 15, 20, 25, 30, 40, -1 } },
+  { "split_len",      { 3, 4, 5, 6, 8, 10, -1 } },
+  { "split_depth",    { 1, 2, 3, 4, 5, 6, -1 } },
+  { "step_len",       { 10, 15, 20, 30, 40, -1 } },
+  { "step_div",       { 5, 8, 10, 15, 20, -1 } },
+  { "corner_span",    { 0, 1, 2, 3, 4, 6, -1 } },
+  { "corner_turn",    { 2, 3, 4, 5, 6, 8, -1 } },
+  { "pyramid_keep",   { 0, 5, 10, 25, 50, -1 } },
+  { "rotate",         { 0, 1, 2, -1 } },
+  { "order_free",     { 0, 1, -1 } },
+  { "stroke_edits",   { 0, 1, 2, -1 } },
+  { "edit_cost",      { 100, 200, 300, 400, 600, 800, -1 } },
+  { "ang_cost_model", { diAngCostCircular, diAngCostLinear, -1 } },
+};
+
+typedef struct {
+  gunichar ch;
+  guint nstrokes;
+  RawStroke *strokes;
+} Query;
+
+typedef struct {
+  guint top1, top5;
+  gint64 usec;			/* CPU time summed over lookups */
+} Result;
+
+typedef struct {
+  const StrokeScorerParams *params;
+  Query *queries;
+  guint n_queries;
+  Result result;
+} Job;
+
+static char *progname;
+static KpJData *jdata;
+static Query *queries;
+static guint n_queries;
+static guint n_threads;
+static glong budget;		/* usec per lookup, 0 for none */
+
+static void
+usage ()
+{
+  fprintf(stderr, "Usage: %s [-f/--data-file FILE] [-p/--profile FILE]\n"
+	  "          [-o/--output FILE] [-j/--jobs N] [-b/--budget USEC]\n"
+	  "          [-r/--rounds N] CORPUS.kpc\n", progname);
+  fprintf(stderr, "Writes the tuned parameters to the output profile\n");
+  fprintf(stderr, "(kanjipad.profile by default) for kpengine --profile.\n");
+  exit(1);
+}
+
+/* Turn the labelled samples into strokes as kpengine would read them */
+static void
+load_queries (KpCorpus *corpus)
+{
+  guint n = kp_corpus_n_samples (corpus);
+  guint i, j, k;
+
+  queries = g_new (Query, n);
+  n_queries = 0;
+
+  for (i = 0; i < n; i++)
+    {
+      KpSample *sample = kp_corpus_get (corpus, i);
+      Query *query = &queries[n_queries];
+
+      if (!sample)
+	{
+	  fprintf(stderr, "%s: corrupt record %u\n", progname, i);
+	  exit(1);
+	}
+
+      query->ch = sample->selected;
+      query->nstrokes = sample->strokes->len;
+
+      if (query->ch && query->nstrokes < diMaxStrokes &&
+	  jdata->dicts[query->nstrokes])
+	{
+	  query->strokes = g_new (RawStroke, query->nstrokes);
+	  for (j = 0; j < query->nstrokes; j++)
+	    {
+	      GArray *points = g_ptr_array_index (sample->strokes, j);
+	      RawStroke *rs = &query->strokes[j];
+
+	      rs->m_len = MIN (points->len, diMaxXyPairs);
+	      for (k = 0; k < rs->m_len; k++)
+		{
+		  rs->m_x[k] = g_array_index (points, KpSamplePoint, k).x;
+		  rs->m_y[k] = g_array_index (points, KpSamplePoint, k).y;
+		}
+	      if (rs->m_len == 0)
+		break;
+	    }
+
+	  if (j == query->nstrokes)
+	    n_queries++;
+	  else
+	    g_free (query->strokes);
+	}
+
+      kp_sample_free (sample);
+    }
+}
+
+/* The workers may outnumber the cores, so time them by the CPU they
+ * used rather than the wall clock.
+ */
+static gint64
+thread_usec ()
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (gint64)ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+static gpointer
+run_job (gpointer data)
+{
+  Job *job = data;
+  StrokeCostCache *caches[diMaxStrokes];
+  gint64 start = thread_usec ();
+  guint i;
+  int j;
+
+  /* Each query's stroke scores are shared by the buckets it tries */
+  for (j = 0; j < diMaxStrokes; j++)
+    if (!(caches[j] = StrokeCostCacheCreate (jdata->paths)))
+      exit(1);
+
+  for (i = 0; i < job->n_queries; i++)
+    {
+      Query *query = &job->queries[i];
+      StrokeScorer *scorer = NULL, *next;
+      ListMem *top_picks;
+      guint edits;
+      gint bucket;
+
+      for (j = 0; j < query->nstrokes; j++)
+	StrokeCostCacheReset (caches[j]);
+
+      /* As kpengine: the query's own bucket, then one fewer stroke,
+       * one more, and so on.
+       */
+      for (edits = 0; edits <= 2 * job->params->m_iStrokeEdits; edits++)
+	{
+	  bucket = query->nstrokes + ((edits + 1) / 2) * ((edits & 1) ? -1 : 1);
+	  if (bucket <= 0 || bucket >= diMaxStrokes || !jdata->dicts[bucket])
+	    continue;
+
+	  next = StrokeScorerCreate (jdata->dicts[bucket],
+				     query->strokes, query->nstrokes);
+	  if (!next)
+	    exit(1);
+	  StrokeScorerSetParams (next, job->params);
+	  for (j = 0; j < query->nstrokes; j++)
+	    StrokeScorerSetCache (next, j, caches[j]);
+	  if (scorer)
+	    {
+	      StrokeScorerSeed (next, scorer);
+	      StrokeScorerDestroy (scorer);
+	    }
+	  scorer = next;
+	  StrokeScorerProcess (scorer, -1);
+	}
+      top_picks = StrokeScorerTopPicks (scorer);
+      StrokeScorerDestroy (scorer);
+
+      for (j = 0; j < top_picks->m_argc; j++)
+	if (g_utf8_get_char (top_picks->m_argv[j]) == query->ch)
+	  {
+	    if (j == 0)
+	      job->result.top1++;
+	    job->result.top5++;
+	    break;
+	  }
+      free (top_picks);
+    }
+
+  job->result.usec = thread_usec () - start;
+
+  for (j = 0; j < diMaxStrokes; j++)
+    StrokeCostCacheDestroy (caches[j]);
+
+  return NULL;
+}
+
+static Result
+evaluate (const StrokeScorerParams *params)
+{
+  Job *jobs = g_new0 (Job, n_threads);
+  GThread **threads = g_new (GThread *, n_threads);
+  Result result = { 0, 0, 0 };
+  guint i;
+
+  for (i = 0; i < n_threads; i++)
+    {
+      guint first = (guint64)n_queries * i / n_threads;
+
+      jobs[i].params = params;
+      jobs[i].queries = queries + first;
+      jobs[i].n_queries = (guint64)n_queries * (i + 1) / n_threads - first;
+      threads[i] = g_thread_new ("kptune", run_job, &jobs[i]);
+    }
+
+  for (i = 0; i < n_threads; i++)
+    {
+      g_thread_join (threads[i]);
+      result.top1 += jobs[i].result.top1;
+      result.top5 += jobs[i].result.top5;
+      result.usec += jobs[i].result.usec;
+    }
+
+  g_free (threads);
+  g_free (jobs);
+
+  return result;
+}
+
+static double
+usec_per_lookup (Result *result)
+{
+  return (double)result->usec / n_queries;
+}
+
+/* Within the budget beats over it; then accuracy; then, when well
+ * clear of timing noise, speed.
+ */
+static gboolean
+better (Result *a, Result *b)
+{
+  gboolean a_fits = !budget || usec_per_lookup (a) <= budget;
+  gboolean b_fits = !budget || usec_per_lookup (b) <= budget;
+
+  if (a_fits != b_fits)
+    return a_fits;
+  if (a_fits && a->top1 != b->top1)
+    return a->top1 > b->top1;
+  if (a_fits && a->top5 != b->top5)
+    return a->top5 > b->top5;
+  return a->usec < b->usec * 0.95;
+}
+
+static void
+report (const char *what, Result *result)
+{
+  fprintf(stderr, "%-20s top-1 %5.1f%%  top-5 %5.1f%%  %7.1f usec\n", what,
+	  100.0 * result->top1 / n_queries, 100.0 * result->top5 / n_queries,
+	  usec_per_lookup (result));
+}
+
+static const glong *
+grid_for (const KpProfileKey *key)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (grids); i++)
+    if (!strcmp (grids[i].key, key->key))
+      return grids[i].values;
+
+  return NULL;
+}
+
+/* One pass over the parameters; returns TRUE if any changed */
+static gboolean
+tune_round (StrokeScorerParams *best, Result *best_result)
+{
+  gboolean changed = FALSE;
+  guint i;
+
+  for (i = 0; i < kp_profile_n_keys; i++)
+    {
+      const KpProfileKey *key = &kp_profile_keys[i];
+      const glong *values = grid_for (key);
+      ULong current = KP_PROFILE_PARAM (best, key);
+
+      for (; values && *values >= 0; values++)
+	{
+	  StrokeScorerParams trial = *best;
+	  Result result;
+	  gchar *what;
+
+	  if (*values == current)
+	    continue;
+
+	  KP_PROFILE_PARAM (&trial, key) = *values;
+	  StrokeScorerAngCosts (&trial);
+	  result = evaluate (&trial);
+
+	  what = g_strdup_printf ("%s=%ld", key->key, *values);
+	  report (what, &result);
+	  g_free (what);
+
+	  if (better (&result, best_result))
+	    {
+	      *best = trial;
+	      *best_result = result;
+	      changed = TRUE;
+	    }
+	}
+    }
+
+  return changed;
+}
+
+int
+main (int argc, char **argv)
+{
+  const char *data_file = NULL, *profile_file = NULL, *corpus_file = NULL;
+  const char *output_file = "kanjipad.profile";
+  int rounds = DEFAULT_ROUNDS;
+  StrokeScorerParams params;
+  KpCorpus *corpus;
+  Result result;
+  GError *err = NULL;
+  gchar *comment;
+  int i;
+
+  progname = argv[0];
+  n_threads = g_get_num_processors ();
+
+  for (i = 1; i < argc; i++)
+    {
+      const char *arg = argv[i];
+
+      if (arg[0] != '-')
+	{
+	  if (corpus_file)
+	    usage ();
+	  corpus_file = arg;
+	  continue;
+	}
+      if (++i >= argc)
+	usage ();
+
+      if (!strcmp (arg, "-f") || !strcmp (arg, "--data-file"))
+	data_file = argv[i];
+      else if (!strcmp (arg, "-p") || !strcmp (arg, "--profile"))
+	profile_file = argv[i];
+      else if (!strcmp (arg, "-o") || !strcmp (arg, "--output"))
+	output_file = argv[i];
+      else if (!strcmp (arg, "-j") || !strcmp (arg, "--jobs"))
+	n_threads = MAX (atoi (argv[i]), 1);
+      else if (!strcmp (arg, "-b") || !strcmp (arg, "--budget"))
+	budget = strtol (argv[i], NULL, 0);
+      else if (!strcmp (arg, "-r") || !strcmp (arg, "--rounds"))
+	rounds = atoi (argv[i]);
+      else
+	usage ();
+    }
+
+  if (!corpus_file)
+    usage ();
+
+  StrokeScorerParamsInit (&params);
+  if ((profile_file && !kp_profile_load (profile_file, &params, &err)) ||
+      !(jdata = kp_jdata_load (data_file, &err)) ||
+      !(corpus = kp_corpus_open (corpus_file, &err)))
+    {
+      fprintf(stderr, "%s: %s\n", progname, err->message);
+      return 1;
+    }
+
+  load_queries (corpus);
+  kp_corpus_close (corpus);
+  if (n_queries == 0)
+    {
+      fprintf(stderr, "%s: %s: no labelled samples to tune with\n",
+	      progname, corpus_file);
+      return 1;
+    }
+  n_threads = MIN (n_threads, n_queries);
+
+  fprintf(stderr, "%s: %u samples, %u threads\n", progname,
+	  n_queries, n_threads);
+
+  result = evaluate (&params);
+  report ("start", &result);
+
+  for (i = 0; i < rounds && tune_round (&params, &result); i++)
+    ;
+
+  report ("tuned", &result);
+  if (budget && usec_per_lookup (&result) > budget)
+    fprintf(stderr, "%s: no parameters found within %ld usec per lookup\n",
+	    progname, budget);
+
+  comment = g_strdup_printf (" Tuned by kptune on %u samples of %s:\n"
+			     " top-1 %.1f%%, top-5 %.1f%%, %.1f usec per lookup",
+			     n_queries, corpus_file,
+			     100.0 * result.top1 / n_queries,
+			     100.0 * result.top5 / n_queries,
+			     usec_per_lookup (&result));
+  if (!kp_profile_save (output_file, &params, comment, &err))
+    {
+      fprintf(stderr, "%s: %s\n", progname, err->message);
+      return 1;
+    }
+  g_free (comment);
+
+  return 0;
+}
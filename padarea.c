@@ -3,165 +3,309 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+/* Motion points are coalesced and drawn at most once per this many
+ * milliseconds (roughly one 60Hz display frame) */
+#define PAD_AREA_FRAME_INTERVAL 16
+
+/* The pad is drawn in two layers. The ink layer is a pixmap holding
+ * the strokes; it only ever grows, so resizing copies the old ink
+ * instead of replaying every stroke. The annotation layer (the stroke
+ * numbers) is never rendered into the pixmap; it is painted over the
+ * ink on expose from cached digit layouts and cached positions, so
+ * toggling it is just an invalidate.
+ */
+
 static void
-pad_area_free_stroke (GList *stroke)
+pad_area_free_stroke (GArray *stroke)
 {
-  GList *tmp_list = stroke;
-  while (tmp_list)
+  g_array_free (stroke, TRUE);
+}
+
+static PangoLayout *
+pad_area_get_digit_layout (PadArea *area, gint index)
+{
+  PangoLayout *layout;
+
+  if (index >= area->digit_layouts->len)
+    g_ptr_array_set_size (area->digit_layouts, index + 1);
+
+  layout = g_ptr_array_index (area->digit_layouts, index);
+  if (!layout)
     {
-      g_free (tmp_list->data);
-      tmp_list = tmp_list->next;
+      char buffer[16];
+
+      sprintf (buffer, "%d", index);
+      layout = gtk_widget_create_pango_layout (area->widget, buffer);
+      g_ptr_array_index (area->digit_layouts, index) = layout;
     }
-  g_list_free (stroke);
+
+  return layout;
 }
 
+static void
+pad_area_flush_digit_layouts (PadArea *area)
+{
+  guint i;
+
+  for (i = 0; i < area->digit_layouts->len; i++)
+    if (g_ptr_array_index (area->digit_layouts, i))
+      g_object_unref (g_ptr_array_index (area->digit_layouts, i));
+  g_ptr_array_set_size (area->digit_layouts, 0);
+}
 
+/* Work out where the number for a stroke goes. The rectangle is
+ * unclamped; a zero width means the stroke is too short to annotate.
+ */
 static void
-pad_area_annotate_stroke (PadArea *area, GList *stroke, gint index)
+pad_area_place_annotation (PadArea *area, GArray *stroke, gint index,
+			   GdkRectangle *rect)
 {
   GdkPoint *cur, *old;
+  guint i;
+
+  rect->x = rect->y = rect->width = rect->height = 0;
 
   /* Annotate the stroke with the stroke number - the algorithm
    * for placing the digit is pretty simple. The text is inscribed
    * in a circle tangent to the stroke. The circle will be above
    * and/or to the left of the line */
-  if (stroke)
+  if (stroke && stroke->len)
     {
-      old = (GdkPoint *)stroke->data;
-      
+      old = &g_array_index (stroke, GdkPoint, 0);
+      i = 0;
+
       do
-	{
-	  cur = (GdkPoint *)stroke->data;
-	  stroke = stroke->next;
-	}
-      while (stroke && abs(cur->x - old->x) < 5 && abs (cur->y - old->y) < 5);
+	cur = &g_array_index (stroke, GdkPoint, i++);
+      while (i < stroke->len && abs(cur->x - old->x) < 5 && abs (cur->y - old->y) < 5);
       
-      if (stroke)
+      if (i < stroke->len)
 	{
-	  char buffer[16];
 	  PangoLayout *layout;
 	  int swidth, sheight;
-	  gint16 x, y;
 	  double r;
 	  double dx = cur->x - old->x;
 	  double dy = cur->y - old->y;
 	  double dl = sqrt(dx*dx+dy*dy);
 	  int sign = (dy <= dx) ? 1 : -1;
-	  GdkRectangle update_area;
 
-	  sprintf (buffer, "%d", index);
-	  layout = gtk_widget_create_pango_layout (GTK_WIDGET(area->widget), buffer);
+	  layout = pad_area_get_digit_layout (area, index);
 	  pango_layout_get_pixel_size (layout, &swidth, &sheight);
 
 	  r = sqrt(swidth*swidth + sheight*sheight);
 	  
-	  x = 0.5 + old->x + 0.5*r*dx/dl + sign * 0.5*r*dy/dl;
-	  y = 0.5 + old->y + 0.5*r*dy/dl - sign * 0.5*r*dx/dl;
+	  rect->x = 0.5 + old->x + 0.5*r*dx/dl + sign * 0.5*r*dy/dl;
+	  rect->y = 0.5 + old->y + 0.5*r*dy/dl - sign * 0.5*r*dx/dl;
 	  
-	  x -= swidth/2;
-	  y -= sheight/2;
+	  rect->x -= swidth/2;
+	  rect->y -= sheight/2;
+	  rect->width = swidth;
+	  rect->height = sheight;
+	}
+    }
+}
 
-	  update_area.x = x;
-	  update_area.y = y;
-	  update_area.width = swidth;
-	  update_area.height = sheight;
-	  
-	  x = CLAMP (x, 0, area->widget->allocation.width - swidth);
-	  y = CLAMP (y, 0, area->widget->allocation.height - sheight);
+/* Where an annotation is actually painted for the current allocation */
+static gboolean
+pad_area_annotation_rect (PadArea *area, guint i, GdkRectangle *rect)
+{
+  *rect = g_array_index (area->annotations, GdkRectangle, i);
+  if (!rect->width)
+    return FALSE;
 
-	  gdk_draw_layout (area->pixmap, 
-			   area->widget->style->black_gc,
-			   x, y, layout);
+  rect->x = CLAMP (rect->x, 0, area->widget->allocation.width - rect->width);
+  rect->y = CLAMP (rect->y, 0, area->widget->allocation.height - rect->height);
 
-	  g_object_unref (layout);
+  return TRUE;
+}
 
-	  gdk_window_invalidate_rect (area->widget->window, &update_area, FALSE);
-	}
-    }
+static void
+pad_area_invalidate_annotations (PadArea *area)
+{
+  GdkRectangle rect;
+  guint i;
+
+  if (!GTK_WIDGET_REALIZED (area->widget))
+    return;
+
+  for (i = 0; i < area->annotations->len; i++)
+    if (pad_area_annotation_rect (area, i, &rect))
+      gdk_window_invalidate_rect (area->widget->window, &rect, FALSE);
 }
 
-static void 
-pad_area_init (PadArea *area)
+static void
+pad_area_style_set (GtkWidget *w, GtkStyle *previous_style, PadArea *area)
 {
-  GList *tmp_list;
-  int index = 1;
-  
-  guint16 width = area->widget->allocation.width;
-  guint16 height = area->widget->allocation.height;
+  guint i;
 
-  gdk_draw_rectangle (area->pixmap, 
-		      area->widget->style->white_gc, TRUE,
-		      0, 0, width, height);
+  /* New font, new digit sizes */
+  pad_area_flush_digit_layouts (area);
 
-  tmp_list = area->strokes;
-  while (tmp_list)
-    {
-      GdkPoint *cur, *old;
-      GList *stroke_list = tmp_list->data;
+  for (i = 0; i < area->annotations->len; i++)
+    pad_area_place_annotation (area, g_ptr_array_index (area->strokes, i), i + 1,
+			       &g_array_index (area->annotations, GdkRectangle, i));
+}
 
-      old = NULL;
+static gboolean
+pad_area_stroke_outside (GArray *stroke, gint width, gint height)
+{
+  guint i;
 
-      if (area->annotate)
-	pad_area_annotate_stroke (area, stroke_list, index);
+  for (i = 0; i < stroke->len; i++)
+    {
+      GdkPoint *p = &g_array_index (stroke, GdkPoint, i);
 
-      while (stroke_list)
-	{
-	  cur = (GdkPoint *)stroke_list->data;
-	  if (old)
-	    gdk_draw_line (area->pixmap, 
-			   area->widget->style->black_gc,
-			   old->x, old->y, cur->x, cur->y);
-
-	  old = cur;
-	  stroke_list = stroke_list->next;
-	}
-      
-      tmp_list = tmp_list->next;
-      index++;
+      if (p->x < 1 || p->y < 1 || p->x >= width - 1 || p->y >= height - 1)
+	return TRUE;
     }
 
-  gtk_widget_queue_draw (area->widget);
-  
+  return FALSE;
 }
 
 static int
 pad_area_configure_event (GtkWidget *w, GdkEventConfigure *event,
 			  PadArea *area)
 {
+  GdkPixmap *pixmap;
+  gint old_width = area->pixmap_width;
+  gint old_height = area->pixmap_height;
+  guint i;
+
+  if (area->pixmap && event->width <= old_width && event->height <= old_height)
+    return TRUE;
+
+  area->pixmap_width = MAX (old_width, event->width);
+  area->pixmap_height = MAX (old_height, event->height);
+
+  pixmap = gdk_pixmap_new (w->window,
+			   area->pixmap_width, area->pixmap_height, -1);
+  gdk_draw_rectangle (pixmap, w->style->white_gc, TRUE,
+		      0, 0, area->pixmap_width, area->pixmap_height);
+
   if (area->pixmap)
-    g_object_unref (area->pixmap);
+    {
+      gdk_draw_drawable (pixmap, w->style->white_gc, area->pixmap,
+			 0, 0, 0, 0, old_width, old_height);
+      g_object_unref (area->pixmap);
+    }
+  area->pixmap = pixmap;
+
+  /* Only strokes that ran off the old pixmap are missing ink */
+  for (i = 0; i < area->strokes->len; i++)
+    {
+      GArray *stroke = g_ptr_array_index (area->strokes, i);
+
+      if (stroke->len > 1 && pad_area_stroke_outside (stroke, old_width, old_height))
+	gdk_draw_lines (area->pixmap, w->style->black_gc,
+			(GdkPoint *)stroke->data, stroke->len);
+    }
 
-  area->pixmap = gdk_pixmap_new (w->window, event->width, event->height, -1);
+  if (area->curstroke && area->drawn > 0 &&
+      pad_area_stroke_outside (area->curstroke, old_width, old_height))
+    gdk_draw_lines (area->pixmap, w->style->black_gc,
+		    (GdkPoint *)area->curstroke->data, area->drawn + 1);
 
-  pad_area_init (area);
-  
   return TRUE;
 }
 
 static int
 pad_area_expose_event (GtkWidget *w, GdkEventExpose *event, PadArea *area)
 {
+  guint i;
+
   if (!area->pixmap)
     return 0;
 
+  area->n_exposes++;
+  area->expose_area += (guint64)event->area.width * event->area.height;
+
   gdk_draw_drawable (w->window,
 		     w->style->fg_gc[GTK_STATE_NORMAL], area->pixmap,
 		     event->area.x, event->area.y,
 		     event->area.x, event->area.y,
 		     event->area.width, event->area.height);
 
+  if (area->annotate)
+    for (i = 0; i < area->annotations->len; i++)
+      {
+	GdkRectangle rect, dummy;
+
+	if (pad_area_annotation_rect (area, i, &rect) &&
+	    gdk_rectangle_intersect (&rect, &event->area, &dummy))
+	  gdk_draw_layout (w->window, w->style->black_gc, rect.x, rect.y,
+			   pad_area_get_digit_layout (area, i + 1));
+      }
+
   return TRUE;
 }
 
+/* Draw the points of the current stroke that have not been drawn yet
+ * and invalidate only their bounding box.
+ */
+static void
+pad_area_flush_stroke (PadArea *area)
+{
+  GdkPoint *points;
+  GdkRectangle rect;
+  gint xmin, ymin, xmax, ymax;
+  guint i, n;
+
+  if (area->frame_source)
+    {
+      g_source_remove (area->frame_source);
+      area->frame_source = 0;
+    }
+
+  if (!area->curstroke || area->drawn + 1 >= area->curstroke->len)
+    return;
+
+  points = &g_array_index (area->curstroke, GdkPoint, area->drawn);
+  n = area->curstroke->len - area->drawn;
+
+  gdk_draw_lines (area->pixmap, area->widget->style->black_gc, points, n);
+
+  xmin = xmax = points[0].x;
+  ymin = ymax = points[0].y;
+  for (i = 1; i < n; i++)
+    {
+      xmin = MIN (xmin, points[i].x);
+      xmax = MAX (xmax, points[i].x);
+      ymin = MIN (ymin, points[i].y);
+      ymax = MAX (ymax, points[i].y);
+    }
+
+  rect.x = xmin - 1;
+  rect.y = ymin - 1;
+  rect.width  = xmax - xmin + 3;
+  rect.height = ymax - ymin + 3;
+  gdk_window_invalidate_rect (area->widget->window, &rect, FALSE);
+
+  area->drawn = area->curstroke->len - 1;
+}
+
+static gboolean
+pad_area_frame_callback (gpointer data)
+{
+  PadArea *area = data;
+
+  area->frame_source = 0;
+  pad_area_flush_stroke (area);
+
+  return FALSE;
+}
+
 static int
 pad_area_button_press_event (GtkWidget *w, GdkEventButton *event, PadArea *area)
 {
   if (event->button == 1)
     {
-      GdkPoint *p = g_new (GdkPoint, 1);
-      p->x = event->x;
-      p->y = event->y;
-      area->curstroke = g_list_append (area->curstroke, p);
+      GdkPoint p;
+      p.x = event->x;
+      p.y = event->y;
+
+      if (!area->curstroke)
+	area->curstroke = g_array_new (FALSE, FALSE, sizeof (GdkPoint));
+      g_array_append_val (area->curstroke, p);
+      area->drawn = area->curstroke->len - 1;
       area->instroke = TRUE;
     }
 
@@ -171,13 +315,28 @@ pad_area_button_press_event (GtkWidget *w, GdkEventButton *event, PadArea *area)
 static int
 pad_area_button_release_event (GtkWidget *w, GdkEventButton *event, PadArea *area)
 {
-  if (area->annotate)
-    pad_area_annotate_stroke (area, area->curstroke, g_list_length (area->strokes) + 1);
+  if (!area->curstroke)
+    return TRUE;
+
+  pad_area_flush_stroke (area);
 
-  area->strokes = g_list_append (area->strokes, area->curstroke);
+  g_array_set_size (area->annotations, area->strokes->len + 1);
+  pad_area_place_annotation (area, area->curstroke, area->strokes->len + 1,
+			     &g_array_index (area->annotations, GdkRectangle,
+					     area->strokes->len));
+
+  g_ptr_array_add (area->strokes, area->curstroke);
   area->curstroke = NULL;
   area->instroke = FALSE;
 
+  if (area->annotate)
+    {
+      GdkRectangle rect;
+
+      if (pad_area_annotation_rect (area, area->annotations->len - 1, &rect))
+	gdk_window_invalidate_rect (w->window, &rect, FALSE);
+    }
+
   pad_area_changed_callback (area);
 
   return TRUE;
@@ -202,30 +361,19 @@ pad_area_motion_event (GtkWidget *w, GdkEventMotion *event, PadArea *area)
 
   if (area->instroke && state & GDK_BUTTON1_MASK)
     {
-      GdkRectangle rect;
-      GdkPoint *p;
-      int xmin, ymin, xmax, ymax;
-      GdkPoint *old = (GdkPoint *)g_list_last (area->curstroke)->data;
-
-      gdk_draw_line (area->pixmap, w->style->black_gc,
-		     old->x, old->y, x, y);
-
-      if (old->x < x) { xmin = old->x; xmax = x; }
-      else            { xmin = x;      xmax = old->x; }
-
-      if (old->y < y) { ymin = old->y; ymax = y; }
-      else            { ymin = y;      ymax = old->y; }
-
-      rect.x = xmin - 1; 
-      rect.y = ymin = 1;
-      rect.width  = xmax - xmin + 2;
-      rect.height = ymax - ymin + 2;
-      gdk_window_invalidate_rect (w->window, &rect, FALSE);
-
-      p = g_new (GdkPoint, 1);
-      p->x = x;
-      p->y = y;
-      area->curstroke = g_list_append (area->curstroke, p);
+      GdkPoint p;
+
+      /* Just queue the point; pad_area_flush_stroke() draws everything
+       * that arrived since the last frame as a single polyline */
+      p.x = x;
+      p.y = y;
+      g_array_append_val (area->curstroke, p);
+
+      if (!area->frame_source)
+	area->frame_source = g_timeout_add_full (GDK_PRIORITY_REDRAW,
+						 PAD_AREA_FRAME_INTERVAL,
+						 pad_area_frame_callback,
+						 area, NULL);
     }
 
   return TRUE;
@@ -248,33 +396,38 @@ PadArea *pad_area_create ()
 		    G_CALLBACK (pad_area_button_release_event), area);
   g_signal_connect (area->widget, "motion_notify_event",
 		    G_CALLBACK (pad_area_motion_event), area);
+  g_signal_connect (area->widget, "style_set",
+		    G_CALLBACK (pad_area_style_set), area);
 
   gtk_widget_set_events (area->widget, 
 			 GDK_EXPOSURE_MASK | GDK_BUTTON_PRESS_MASK 
 			 | GDK_BUTTON_RELEASE_MASK | GDK_POINTER_MOTION_MASK 
 			 | GDK_POINTER_MOTION_HINT_MASK);
 
-  area->strokes = NULL;
+  area->strokes = g_ptr_array_new ();
   area->curstroke = NULL;
   area->instroke = FALSE;
   area->annotate = FALSE;
   area->pixmap = NULL;
+  area->pixmap_width = 0;
+  area->pixmap_height = 0;
+  area->annotations = g_array_new (FALSE, FALSE, sizeof (GdkRectangle));
+  area->digit_layouts = g_ptr_array_new ();
+  area->drawn = 0;
+  area->frame_source = 0;
+  area->n_exposes = 0;
+  area->expose_area = 0;
 
   return area;
 }
 
 void pad_area_clear (PadArea *area)
 {
-  GList *tmp_list;
+  guint i;
 
-  tmp_list = area->strokes;
-  while (tmp_list)
-    {
-      pad_area_free_stroke (tmp_list->data);
-      tmp_list = tmp_list->next;
-    }
-  g_list_free (area->strokes);
-  area->strokes = NULL;
+  for (i = 0; i < area->strokes->len; i++)
+    pad_area_free_stroke (g_ptr_array_index (area->strokes, i));
+  g_ptr_array_set_size (area->strokes, 0);
 
 #if 0
   tmp_list = thinned;
@@ -287,20 +440,74 @@ void pad_area_clear (PadArea *area)
   thinned = NULL;
 #endif
 
-  g_list_free (area->curstroke);
+  if (area->frame_source)
+    {
+      g_source_remove (area->frame_source);
+      area->frame_source = 0;
+    }
+
+  if (area->curstroke)
+    pad_area_free_stroke (area->curstroke);
   area->curstroke = NULL;
+  area->instroke = FALSE;
+  area->drawn = 0;
+
+  g_debug ("pad area: %lu exposes, %" G_GUINT64_FORMAT " pixels",
+	   area->n_exposes, area->expose_area);
+  area->n_exposes = 0;
+  area->expose_area = 0;
 
-  pad_area_init (area);
+  g_array_set_size (area->annotations, 0);
+
+  if (area->pixmap)
+    {
+      gdk_draw_rectangle (area->pixmap, area->widget->style->white_gc, TRUE,
+			  0, 0, area->pixmap_width, area->pixmap_height);
+      gtk_widget_queue_draw (area->widget);
+    }
 
   pad_area_changed_callback (area);  
 }
 
+/* Take back the last stroke. The ink can't be scraped off the pixmap,
+ * so the remaining strokes are drawn again on a clean one.
+ */
+void pad_area_undo (PadArea *area)
+{
+  guint i;
+
+  if (area->instroke || !area->strokes->len)
+    return;
+
+  pad_area_free_stroke (g_ptr_array_index (area->strokes, area->strokes->len - 1));
+  g_ptr_array_set_size (area->strokes, area->strokes->len - 1);
+  g_array_set_size (area->annotations, area->strokes->len);
+
+  if (area->pixmap)
+    {
+      gdk_draw_rectangle (area->pixmap, area->widget->style->white_gc, TRUE,
+			  0, 0, area->pixmap_width, area->pixmap_height);
+
+      for (i = 0; i < area->strokes->len; i++)
+	{
+	  GArray *stroke = g_ptr_array_index (area->strokes, i);
+
+	  if (stroke->len > 1)
+	    gdk_draw_lines (area->pixmap, area->widget->style->black_gc,
+			    (GdkPoint *)stroke->data, stroke->len);
+	}
+      gtk_widget_queue_draw (area->widget);
+    }
+
+  pad_area_changed_callback (area);
+}
+
 void pad_area_set_annotate (PadArea *area, gint annotate)
 {
   if (area->annotate != annotate)
     {
       area->annotate = annotate;
-      pad_area_init (area);
+      pad_area_invalidate_annotations (area);
     }
 }
 
@@ -0,0 +1,172 @@
+/* KanjiPad - Japanese handwriting recognition front end
+ * Copyright (C) 1997 Owen Taylor
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "profile.h"
+
+#define PARAM_KEY(key, member, min, max) \
+  { key, G_STRUCT_OFFSET (StrokeScorerParams, member), min, max }
+
+/* The bounds keep every cost StrokeDicScoreStroke can form within a
+ * ULong and every split step at least one point.
+ */
+const KpProfileKey kp_profile_keys[] = {
+  PARAM_KEY ("ang_cost_base", m_iAngCostBase, 0, 10000),
+  PARAM_KEY ("ang_cost_scale", m_iAngCostScale, 0, 10000),
+  PARAM_KEY ("split_dist", m_iSplitDist, 0, 400),
+  PARAM_KEY ("split_len", m_iSplitLen, 0, diMaxXyPairs),
+  PARAM_KEY ("split_depth", m_iSplitDepth, 0, 16),
+  PARAM_KEY ("step_len", m_iStepLen, 0, diMaxXyPairs),
+  PARAM_KEY ("step_div", m_iStepDiv, 1, diMaxXyPairs),
+  PARAM_KEY ("corner_span", m_iCornerSpan, 0, diMaxXyPairs),
+  PARAM_KEY ("corner_turn", m_iCornerTurn, 0, 16),
+  PARAM_KEY ("pyramid_keep", m_iPyramidKeep, 0, 100),
+  PARAM_KEY ("rotate", m_iRotate, 0, diMaxRotate),
+  PARAM_KEY ("order_free", m_iOrderFree, 0, 1),
+  PARAM_KEY ("stroke_edits", m_iStrokeEdits, 0, diMaxStrokeEdits),
+  PARAM_KEY ("edit_cost", m_iEditCost, 0, 10000),
+  PARAM_KEY ("ang_cost_model", m_iAngCostModel, 0, diAngCostTable),
+};
+
+const guint kp_profile_n_keys = G_N_ELEMENTS (kp_profile_keys);
+
+#define ANG_COST_KEY "ang_cost"
+#define ANG_COST_MAX 1000000
+
+static gboolean
+load_ang_costs (GKeyFile *key_file, const gchar *filename,
+		StrokeScorerParams *params, GError **error)
+{
+  gint *costs;
+  gsize length, i;
+
+  costs = g_key_file_get_integer_list (key_file, KP_PROFILE_GROUP,
+				       ANG_COST_KEY, &length, error);
+  if (!costs)
+    return FALSE;
+
+  if (length != diAngCodes * diAngCodes)
+    {
+      g_set_error (error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+		   "%s: %s must have %d values", filename, ANG_COST_KEY,
+		   diAngCodes * diAngCodes);
+      g_free (costs);
+      return FALSE;
+    }
+
+  for (i = 0; i < length; i++)
+    {
+      if (costs[i] < 0 || costs[i] > ANG_COST_MAX)
+	{
+	  g_set_error (error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+		       "%s: %s values must be between 0 and %d", filename,
+		       ANG_COST_KEY, ANG_COST_MAX);
+	  g_free (costs);
+	  return FALSE;
+	}
+      params->m_aiAngCost[i / diAngCodes][i % diAngCodes] = costs[i];
+    }
+
+  g_free (costs);
+  return TRUE;
+}
+
+gboolean
+kp_profile_load (const gchar *filename, StrokeScorerParams *params,
+		 GError **error)
+{
+  GKeyFile *key_file = g_key_file_new ();
+  StrokeScorerParams loaded;
+  guint i;
+
+  if (!g_key_file_load_from_file (key_file, filename, G_KEY_FILE_NONE, error))
+    goto error;
+
+  StrokeScorerParamsInit (&loaded);
+
+  for (i = 0; i < kp_profile_n_keys; i++)
+    {
+      const KpProfileKey *key = &kp_profile_keys[i];
+      GError *err = NULL;
+      gint val;
+
+      if (!g_key_file_has_key (key_file, KP_PROFILE_GROUP, key->key, NULL))
+	continue;
+
+      val = g_key_file_get_integer (key_file, KP_PROFILE_GROUP, key->key, &err);
+      if (err)
+	{
+	  g_propagate_error (error, err);
+	  goto error;
+	}
+      if (val < 0 || (gulong)val < key->min || (gulong)val > key->max)
+	{
+	  g_set_error (error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+		       "%s: %s must be between %lu and %lu", filename,
+		       key->key, key->min, key->max);
+	  goto error;
+	}
+      KP_PROFILE_PARAM (&loaded, key) = val;
+    }
+
+  if (loaded.m_iAngCostModel == diAngCostTable &&
+      !load_ang_costs (key_file, filename, &loaded, error))
+    goto error;
+  StrokeScorerAngCosts (&loaded);
+
+  g_key_file_free (key_file);
+  *params = loaded;
+  return TRUE;
+
+ error:
+  g_key_file_free (key_file);
+  return FALSE;
+}
+
+gboolean
+kp_profile_save (const gchar *filename, const StrokeScorerParams *params,
+		 const gchar *comment, GError **error)
+{
+  GKeyFile *key_file = g_key_file_new ();
+  gchar *data;
+  gsize length;
+  gboolean result;
+  guint i;
+
+  for (i = 0; i < kp_profile_n_keys; i++)
+    g_key_file_set_integer (key_file, KP_PROFILE_GROUP, kp_profile_keys[i].key,
+			    KP_PROFILE_PARAM (params, &kp_profile_keys[i]));
+  if (params->m_iAngCostModel == diAngCostTable)
+    {
+      gint costs[diAngCodes * diAngCodes];
+
+      for (i = 0; i < G_N_ELEMENTS (costs); i++)
+	costs[i] = params->m_aiAngCost[i / diAngCodes][i % diAngCodes];
+      g_key_file_set_integer_list (key_file, KP_PROFILE_GROUP, ANG_COST_KEY,
+				   costs, G_N_ELEMENTS (costs));
+    }
+  if (comment)
+    g_key_file_set_comment (key_file, KP_PROFILE_GROUP, NULL, comment, NULL);
+
+  data = g_key_file_to_data (key_file, &length, NULL);
+  result = g_file_set_contents (filename, data, length, error);
+
+  g_free (data);
+  g_key_file_free (key_file);
+
+  return result;
+}
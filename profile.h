@@ -0,0 +1,58 @@
+/* KanjiPad - Japanese handwriting recognition front end
+ * Copyright (C) 1997 Owen Taylor
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#include <glib.h>
+#include "jstroke/jstroke.h"
+
+/* A profile is a key file holding scorer parameters, as written by
+ * kptune and read by kpengine --profile:
+ *
+ *   [scorer]
+ *   ang_cost_base=52
+ *   ...
+ *
+ * Keys that are missing keep their built-in values.  With
+ * ang_cost_model=2 (diAngCostTable), ang_cost lists the cost of each
+ * Angle32 segment direction against each path direction, 32 values a
+ * segment direction.
+ */
+
+#define KP_PROFILE_GROUP "scorer"
+
+typedef struct {
+  const gchar *key;
+  gsize offset;			/* of a ULong in StrokeScorerParams */
+  gulong min, max;
+} KpProfileKey;
+
+extern const KpProfileKey kp_profile_keys[];
+extern const guint kp_profile_n_keys;
+
+#define KP_PROFILE_PARAM(params, key) \
+  G_STRUCT_MEMBER (ULong, (params), (key)->offset)
+
+gboolean kp_profile_load (const gchar *filename, StrokeScorerParams *params,
+			  GError **error);
+gboolean kp_profile_save (const gchar *filename,
+			  const StrokeScorerParams *params,
+			  const gchar *comment, GError **error);
+
+#endif /* __PROFILE_H__ */
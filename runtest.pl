@@ -2,6 +2,7 @@
 
 use IO::File;
 use IPC::Open2 qw(open2);
+use Encode;
 
 use strict;
 
@@ -21,9 +22,17 @@ my @scores;
 
 $/ = "";
 while (<>) {
-    my ($jis, $strokes) = /(\w{4})\s[^\n]*\n(.*)/s;
-    defined $jis or warn "Bad stroke entry:\n$_\n", next;
-    next if ($jis eq "0000");
+    my ($code, $strokes) = /((?:U\+)?\w{4,6})\s[^\n]*\n(.*)/s;
+    defined $code or warn "Bad stroke entry:\n$_\n", next;
+    next if ($code eq "0000");
+
+    # The engine answers in Unicode; old samples are tagged with hex JIS
+    my $ucs;
+    if ($code =~ /^U\+(\w+)$/) {
+	$ucs = sprintf("%x", hex($1));
+    } else {
+	$ucs = sprintf("%x", ord(decode("jis0208-raw", pack("H4", $code))));
+    }
 
     print $out $strokes;
     $/ = "\n";
@@ -32,7 +41,7 @@ while (<>) {
 
     my $score = 0;
     for (@result) {
-	last if $_ eq $jis;
+	last if $_ eq $ucs;
 	$score++;
     }
     
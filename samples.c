@@ -0,0 +1,475 @@
+/* KanjiPad - Japanese handwriting recognition front end
+ * Copyright (C) 1997 Owen Taylor
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "samples.h"
+#include "jistab.h"
+
+struct _KpSampleRecorder {
+  int fd;
+  gchar *filename;
+  GAsyncQueue *queue;
+  GThread *thread;
+};
+
+/* Pushed by kp_sample_recorder_free() to stop the writer */
+static KpSample recorder_quit;
+
+KpSample *
+kp_sample_new (void)
+{
+  KpSample *sample = g_new (KpSample, 1);
+
+  sample->time = 0;
+  sample->selected = 0;
+  sample->candidates = g_array_new (FALSE, FALSE, sizeof (gunichar));
+  sample->strokes = g_ptr_array_new ();
+
+  return sample;
+}
+
+void
+kp_sample_free (KpSample *sample)
+{
+  guint i;
+
+  for (i = 0; i < sample->strokes->len; i++)
+    g_array_free (g_ptr_array_index (sample->strokes, i), TRUE);
+  g_ptr_array_free (sample->strokes, TRUE);
+  g_array_free (sample->candidates, TRUE);
+  g_free (sample);
+}
+
+GArray *
+kp_sample_add_stroke (KpSample *sample)
+{
+  GArray *stroke = g_array_new (FALSE, FALSE, sizeof (KpSamplePoint));
+
+  g_ptr_array_add (sample->strokes, stroke);
+
+  return stroke;
+}
+
+/* Binary records */
+
+static void
+put_varint (GString *out, guint64 val)
+{
+  while (val >= 0x80)
+    {
+      g_string_append_c (out, (gchar)((val & 0x7f) | 0x80));
+      val >>= 7;
+    }
+  g_string_append_c (out, (gchar)val);
+}
+
+static void
+put_zigzag (GString *out, gint val)
+{
+  put_varint (out, val < 0 ? ((guint64)(-(gint64)val) << 1) - 1 : (guint64)val << 1);
+}
+
+static gboolean
+get_varint (const guchar **p, const guchar *end, guint64 *val)
+{
+  guint shift = 0;
+
+  *val = 0;
+  while (*p < end && shift < 64)
+    {
+      guchar c = *(*p)++;
+
+      *val |= (guint64)(c & 0x7f) << shift;
+      if (!(c & 0x80))
+	return TRUE;
+      shift += 7;
+    }
+
+  return FALSE;
+}
+
+static gboolean
+get_zigzag (const guchar **p, const guchar *end, gint *val)
+{
+  guint64 u;
+
+  if (!get_varint (p, end, &u))
+    return FALSE;
+  *val = (u & 1) ? -(gint64)(u >> 1) - 1 : (gint64)(u >> 1);
+
+  return TRUE;
+}
+
+void
+kp_sample_encode (const KpSample *sample, GString *out)
+{
+  GString *body = g_string_sized_new (256);
+  guint i, j;
+
+  put_varint (body, sample->time);
+  put_varint (body, sample->selected);
+
+  put_varint (body, sample->candidates->len);
+  for (i = 0; i < sample->candidates->len; i++)
+    put_varint (body, g_array_index (sample->candidates, gunichar, i));
+
+  put_varint (body, sample->strokes->len);
+  for (i = 0; i < sample->strokes->len; i++)
+    {
+      GArray *stroke = g_ptr_array_index (sample->strokes, i);
+      KpSamplePoint last = { 0, 0 };
+
+      put_varint (body, stroke->len);
+      for (j = 0; j < stroke->len; j++)
+	{
+	  KpSamplePoint *pt = &g_array_index (stroke, KpSamplePoint, j);
+
+	  put_zigzag (body, pt->x - last.x);
+	  put_zigzag (body, pt->y - last.y);
+	  last = *pt;
+	}
+    }
+
+  put_varint (out, body->len);
+  g_string_append_len (out, body->str, body->len);
+  g_string_free (body, TRUE);
+}
+
+KpSample *
+kp_sample_decode (const guchar **p, const guchar *end)
+{
+  KpSample *sample;
+  const guchar *q = *p;
+  guint64 len, val, n, m, i, j;
+
+  if (!get_varint (&q, end, &len) || len > (guint64)(end - q))
+    return NULL;
+  end = q + len;
+
+  sample = kp_sample_new ();
+
+  if (!get_varint (&q, end, &val))
+    goto corrupt;
+  sample->time = val;
+
+  if (!get_varint (&q, end, &val))
+    goto corrupt;
+  sample->selected = val;
+
+  if (!get_varint (&q, end, &n) || n > len)
+    goto corrupt;
+  for (i = 0; i < n; i++)
+    {
+      gunichar ch;
+
+      if (!get_varint (&q, end, &val))
+	goto corrupt;
+      ch = val;
+      g_array_append_val (sample->candidates, ch);
+    }
+
+  if (!get_varint (&q, end, &n) || n > len)
+    goto corrupt;
+  for (i = 0; i < n; i++)
+    {
+      GArray *stroke = kp_sample_add_stroke (sample);
+      KpSamplePoint pt = { 0, 0 };
+
+      if (!get_varint (&q, end, &m) || m > len)
+	goto corrupt;
+      for (j = 0; j < m; j++)
+	{
+	  gint dx, dy;
+
+	  if (!get_zigzag (&q, end, &dx) || !get_zigzag (&q, end, &dy))
+	    goto corrupt;
+	  pt.x += dx;
+	  pt.y += dy;
+	  g_array_append_val (stroke, pt);
+	}
+    }
+
+  *p = end;
+  return sample;
+
+ corrupt:
+  kp_sample_free (sample);
+  return NULL;
+}
+
+gboolean
+kp_sample_file_load (const gchar *filename, gchar **contents,
+		     gsize *length, GError **error)
+{
+  if (!g_file_get_contents (filename, contents, length, error))
+    return FALSE;
+
+  if (*length < KP_SAMPLE_MAGIC_LEN ||
+      memcmp (*contents, KP_SAMPLE_MAGIC, KP_SAMPLE_MAGIC_LEN) != 0)
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+		   "'%s' is not a KanjiPad sample file", filename);
+      g_free (*contents);
+      *contents = NULL;
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Old text format */
+
+static gboolean
+read_line (FILE *file, GString *line)
+{
+  int c;
+
+  g_string_truncate (line, 0);
+  while ((c = getc (file)) != EOF && c != '\n')
+    g_string_append_c (line, c);
+
+  return c != EOF || line->len > 0;
+}
+
+KpSample *
+kp_sample_read_text (FILE *file)
+{
+  GString *line = g_string_new (NULL);
+  KpSample *sample = NULL;
+  gchar *p;
+
+  /* Skip to the tag line */
+  do
+    if (!read_line (file, line))
+      goto out;
+  while (line->len == 0);
+
+  sample = kp_sample_new ();
+
+  /* "U+XXXX <char>" or, from older versions, hex JIS and EUC-JP */
+  if (line->str[0] == 'U' && line->str[1] == '+')
+    sample->selected = strtoul (line->str + 2, NULL, 16);
+  else
+    {
+      unsigned int t1, t2;
+
+      if (sscanf (line->str, "%2x%2x", &t1, &t2) == 2 && KP_JIS_VALID (t1, t2))
+	sample->selected = kp_jis_ucs[KP_JIS_INDEX (t1, t2)];
+    }
+
+  while (read_line (file, line) && line->len)
+    {
+      GArray *stroke = kp_sample_add_stroke (sample);
+
+      p = line->str;
+      while (*p)
+	{
+	  KpSamplePoint pt;
+	  gchar *q;
+
+	  pt.x = strtol (p, &q, 10);
+	  if (q == p)
+	    break;
+	  pt.y = strtol (q, &p, 10);
+	  if (p == q)
+	    break;
+	  g_array_append_val (stroke, pt);
+	}
+    }
+
+ out:
+  g_string_free (line, TRUE);
+  return sample;
+}
+
+void
+kp_sample_write_text (const KpSample *sample, FILE *file, int unknown_id)
+{
+  guint i, j;
+
+  if (sample->selected)
+    {
+      gchar buf[8];
+
+      buf[g_unichar_to_utf8 (sample->selected, buf)] = '\0';
+      fprintf (file, "U+%04X %s\n", sample->selected, buf);
+    }
+  else
+    fprintf (file, "0000 ??%d\n", unknown_id);
+
+  for (i = 0; i < sample->strokes->len; i++)
+    {
+      GArray *stroke = g_ptr_array_index (sample->strokes, i);
+
+      for (j = 0; j < stroke->len; j++)
+	{
+	  KpSamplePoint *pt = &g_array_index (stroke, KpSamplePoint, j);
+	  fprintf (file, "%d %d ", pt->x, pt->y);
+	}
+      fprintf (file, "\n");
+    }
+  fprintf (file, "\n");
+}
+
+/* Background recorder */
+
+static gboolean
+write_all (KpSampleRecorder *recorder, const gchar *buf, gsize len)
+{
+  while (len)
+    {
+      ssize_t n = write (recorder->fd, buf, len);
+
+      if (n < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  g_warning ("Cannot write to '%s': %s", recorder->filename,
+		     g_strerror (errno));
+	  return FALSE;
+	}
+      buf += n;
+      len -= n;
+    }
+
+  return TRUE;
+}
+
+static gpointer
+recorder_thread (gpointer data)
+{
+  KpSampleRecorder *recorder = data;
+  GString *batch = g_string_new (NULL);
+  gint64 last_sync = g_get_monotonic_time ();
+  gboolean dirty = FALSE;
+  gboolean done = FALSE;
+
+  while (!done)
+    {
+      KpSample *sample;
+
+      sample = g_async_queue_timeout_pop (recorder->queue,
+					  KP_SAMPLE_SYNC_INTERVAL * G_USEC_PER_SEC);
+
+      /* Everything that queued up meanwhile goes out in one write */
+      for (; sample; sample = g_async_queue_try_pop (recorder->queue))
+	{
+	  if (sample == &recorder_quit)
+	    {
+	      done = TRUE;
+	      continue;
+	    }
+	  kp_sample_encode (sample, batch);
+	  kp_sample_free (sample);
+	}
+
+      if (batch->len)
+	{
+	  write_all (recorder, batch->str, batch->len);
+	  g_string_truncate (batch, 0);
+	  dirty = TRUE;
+	}
+
+      if (dirty && (done || g_get_monotonic_time () - last_sync >=
+		    KP_SAMPLE_SYNC_INTERVAL * G_USEC_PER_SEC))
+	{
+	  fsync (recorder->fd);
+	  last_sync = g_get_monotonic_time ();
+	  dirty = FALSE;
+	}
+    }
+
+  g_string_free (batch, TRUE);
+
+  return NULL;
+}
+
+KpSampleRecorder *
+kp_sample_recorder_new (const gchar *filename, GError **error)
+{
+  KpSampleRecorder *recorder;
+  struct stat st;
+  char magic[KP_SAMPLE_MAGIC_LEN];
+  int fd;
+
+  fd = open (filename, O_RDWR | O_APPEND | O_CREAT, 0644);
+  if (fd < 0 || fstat (fd, &st) < 0)
+    {
+      int save_errno = errno;
+
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (save_errno),
+		   "Can't open '%s': %s", filename, g_strerror (save_errno));
+      if (fd >= 0)
+	close (fd);
+      return NULL;
+    }
+
+  if (st.st_size == 0)
+    {
+      if (write (fd, KP_SAMPLE_MAGIC, KP_SAMPLE_MAGIC_LEN) != KP_SAMPLE_MAGIC_LEN)
+	{
+	  g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+		       "Can't write '%s': %s", filename, g_strerror (errno));
+	  close (fd);
+	  return NULL;
+	}
+    }
+  else if (pread (fd, magic, KP_SAMPLE_MAGIC_LEN, 0) != KP_SAMPLE_MAGIC_LEN ||
+	   memcmp (magic, KP_SAMPLE_MAGIC, KP_SAMPLE_MAGIC_LEN) != 0)
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+		   "'%s' is not a KanjiPad sample file", filename);
+      close (fd);
+      return NULL;
+    }
+
+  recorder = g_new (KpSampleRecorder, 1);
+  recorder->fd = fd;
+  recorder->filename = g_strdup (filename);
+  recorder->queue = g_async_queue_new ();
+  recorder->thread = g_thread_new ("kp-samples", recorder_thread, recorder);
+
+  return recorder;
+}
+
+void
+kp_sample_recorder_push (KpSampleRecorder *recorder, KpSample *sample)
+{
+  if (!sample->time)
+    sample->time = g_get_real_time ();
+  g_async_queue_push (recorder->queue, sample);
+}
+
+void
+kp_sample_recorder_free (KpSampleRecorder *recorder)
+{
+  g_async_queue_push (recorder->queue, &recorder_quit);
+  g_thread_join (recorder->thread);
+
+  close (recorder->fd);
+  g_async_queue_unref (recorder->queue);
+  g_free (recorder->filename);
+  g_free (recorder);
+}
@@ -0,0 +1,87 @@
+/* KanjiPad - Japanese handwriting recognition front end
+ * Copyright (C) 1997 Owen Taylor
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef __SAMPLES_H__
+#define __SAMPLES_H__
+
+#include <stdio.h>
+#include <glib.h>
+
+/* A sample file is the magic "KPS1" followed by records appended one
+ * after another. Each record is
+ *
+ *   varint  length of the rest of the record
+ *   varint  time saved, microseconds since the epoch
+ *   varint  selected character (Unicode), 0 if unknown
+ *   varint  number of candidates, then a varint code point for each
+ *   varint  number of strokes, then for each stroke
+ *     varint  number of points
+ *     zigzag varint x, y of the first point, then dx, dy of each
+ *             further point from the one before
+ *
+ * Varints are little-endian base 128; zigzag maps signed to unsigned
+ * so that small negative deltas stay short.
+ */
+
+#define KP_SAMPLE_MAGIC "KPS1"
+#define KP_SAMPLE_MAGIC_LEN 4
+
+typedef struct {
+  gint x, y;
+} KpSamplePoint;
+
+typedef struct {
+  gint64 time;
+  gunichar selected;
+  GArray *candidates;		/* gunichar */
+  GPtrArray *strokes;		/* a GArray of KpSamplePoint per stroke */
+} KpSample;
+
+typedef struct _KpSampleRecorder KpSampleRecorder;
+
+KpSample *kp_sample_new (void);
+void kp_sample_free (KpSample *sample);
+GArray *kp_sample_add_stroke (KpSample *sample);
+
+/* Append the encoded record to out */
+void kp_sample_encode (const KpSample *sample, GString *out);
+/* Decode the record at *p, advancing *p past it. Returns NULL at a
+ * truncated or corrupt record. */
+KpSample *kp_sample_decode (const guchar **p, const guchar *end);
+
+/* The old blank-line separated text format of samples.dat. Reading
+ * returns NULL at end of file; unknown characters are saved as
+ * "0000 ??<unknown_id>". */
+KpSample *kp_sample_read_text (FILE *file);
+void kp_sample_write_text (const KpSample *sample, FILE *file, int unknown_id);
+
+/* Read a whole sample file into memory, checking the magic */
+gboolean kp_sample_file_load (const gchar *filename, gchar **contents,
+			      gsize *length, GError **error);
+
+/* Samples pushed to a recorder are encoded and appended to the file by
+ * a background thread, which syncs the file at most once per
+ * KP_SAMPLE_SYNC_INTERVAL seconds. Freeing the recorder writes and
+ * syncs everything still queued. */
+#define KP_SAMPLE_SYNC_INTERVAL 2
+
+KpSampleRecorder *kp_sample_recorder_new (const gchar *filename, GError **error);
+void kp_sample_recorder_push (KpSampleRecorder *recorder, KpSample *sample);
+void kp_sample_recorder_free (KpSampleRecorder *recorder);
+
+#endif /* __SAMPLES_H__ */